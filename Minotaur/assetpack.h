@@ -0,0 +1,38 @@
+#ifndef ASSETPACK_H
+#define ASSETPACK_H
+
+#include <stdint.h>
+
+// Binary asset pack shared by the game (which maps it read-only) and mkpack (which writes it).
+//
+// Layout, all integers little-endian:
+//   PackHeader
+//   PackEntry[count]
+//   texel data: each image is width*height RGBA texels, one byte per channel in
+//   R,G,B,A order, rows top to bottom, starting at a PACK_ALIGN-aligned offset
+//
+// Width and height are powers of two. Read as uint32_t on a little-endian host a
+// texel equals PACK_RGB() in raycaster.c, so the game samples the mapping directly.
+
+#define PACK_MAGIC "MINOPAK1"
+#define PACK_VERSION 1
+#define PACK_ALIGN 16
+#define PACK_NAME_LEN 16
+
+typedef struct {
+    char magic[8]; // PACK_MAGIC, not NUL terminated
+    uint32_t version; // PACK_VERSION
+    uint32_t count; // Number of entries
+} PackHeader;
+
+typedef struct {
+    char name[PACK_NAME_LEN]; // NUL terminated, e.g. "T_1"
+    uint32_t width; // Power of two
+    uint32_t height; // Power of two
+    uint32_t offset; // Byte offset of the texels from the start of the file
+    uint32_t flags; // PACK_FLAG_*
+} PackEntry;
+
+#define PACK_FLAG_ALPHA 1 // Some texels are transparent (alpha 0)
+
+#endif
@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include "assetpack.h"
+
+// MKPACK: converts images into the binary asset pack the game maps at startup.
+//
+// Build: gcc -O2 mkpack.c -o mkpack
+// Usage: mkpack out.pak name=path[@WxH][#RRGGBB] ...
+//
+// Sources can be real PPM files (P3 or P6) or the legacy "int name[] = {...}" texture
+// sources, which carry no size: square images are detected, others need @WxH.
+// #RRGGBB makes every texel of that colour transparent (e.g. white splash backgrounds).
+//
+// Example, from the Minotaur directory (one command):
+//   ./mkpack minotaur.pak T_1=Textures/T_1.ppm T_2=Textures/T_2.ppm T_3=Textures/T_3.ppm
+//       T_4=Textures/T_4.ppm key=Textures/key.ppm#000000
+//       start=Textures/start.ppm@1024x512#ffffff intro=Textures/intro.ppm@1024x512#ffffff
+//       win=Textures/win.ppm@1024x512#ffffff
+
+#define MAX_ENTRIES 256
+
+typedef struct {
+    char name[PACK_NAME_LEN];
+    int width, height;
+    int hasKey; // Colour key set
+    unsigned char key[3];
+    unsigned char *rgba; // width*height*4 bytes
+} Image;
+
+Image images[MAX_ENTRIES];
+
+int isPow2(int v)
+{
+    return v > 0 && (v & (v - 1)) == 0;
+}
+
+char *readFile(const char *path, long *size)
+{
+    FILE *f = fopen(path, "rb");
+    char *data;
+    if(!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = (char *)malloc(*size + 1);
+    if(data && fread(data, 1, *size, f) != (size_t)*size) {
+        free(data);
+        data = NULL;
+    }
+    if(data) data[*size] = 0;
+    fclose(f);
+    return data;
+}
+
+// Skips whitespace and # comments in a PPM header
+const char *skipPPMSpace(const char *p, const char *end)
+{
+    while(p < end) {
+        if(*p == '#') { while(p < end && *p != '\n') p++; }
+        else if(isspace((unsigned char)*p)) p++;
+        else break;
+    }
+    return p;
+}
+
+const char *readPPMInt(const char *p, const char *end, int *out)
+{
+    p = skipPPMSpace(p, end);
+    if(p >= end || !isdigit((unsigned char)*p)) return NULL;
+    *out = 0;
+    while(p < end && isdigit((unsigned char)*p)) *out = *out * 10 + (*p++ - '0');
+    return p;
+}
+
+// Fills img->rgba from a P3/P6 PPM; returns 0 on malformed input
+int loadPPM(Image *img, const char *data, long size)
+{
+    const char *p = data + 2, *end = data + size;
+    int binary = data[1] == '6';
+    int maxval, i, c;
+
+    if(!(p = readPPMInt(p, end, &img->width)) || !(p = readPPMInt(p, end, &img->height)) ||
+       !(p = readPPMInt(p, end, &maxval)) || maxval <= 0 || maxval > 65535) return 0;
+
+    img->rgba = (unsigned char *)malloc((size_t)img->width * img->height * 4);
+    if(!img->rgba) return 0;
+    if(binary) p++; // Single whitespace before the raster
+
+    for(i = 0; i < img->width * img->height; i++) {
+        for(c = 0; c < 3; c++) {
+            int v;
+            if(binary) {
+                if(maxval < 256) { if(p >= end) return 0; v = (unsigned char)*p++; }
+                else { if(p + 1 >= end) return 0; v = ((unsigned char)p[0] << 8) | (unsigned char)p[1]; p += 2; }
+            } else if(!(p = readPPMInt(p, end, &v))) return 0;
+            img->rgba[i*4 + c] = (unsigned char)(v * 255 / maxval);
+        }
+        img->rgba[i*4 + 3] = 255;
+    }
+    return 1;
+}
+
+// Fills img->rgba from a legacy C int array; width/height may be preset from @WxH
+int loadIntArray(Image *img, const char *data)
+{
+    const char *p = strchr(data, '{');
+    long count = 0, capacity = 1 << 16, i;
+    int *values = (int *)malloc(capacity * sizeof(int));
+
+    if(!p || !values) return 0;
+    for(p++; *p && *p != '}'; ) {
+        if(isdigit((unsigned char)*p)) {
+            if(count == capacity) {
+                capacity *= 2;
+                values = (int *)realloc(values, capacity * sizeof(int));
+                if(!values) return 0;
+            }
+            values[count++] = (int)strtol(p, (char **)&p, 10);
+        } else p++;
+    }
+
+    if(!img->width) {
+        // No size given: only square images can be inferred
+        int side = 1;
+        while((long)side * side * 3 < count) side++;
+        img->width = img->height = side;
+    }
+    if((long)img->width * img->height * 3 != count) {
+        free(values);
+        return 0;
+    }
+
+    img->rgba = (unsigned char *)malloc((size_t)img->width * img->height * 4);
+    if(!img->rgba) return 0;
+    for(i = 0; i < (long)img->width * img->height; i++) {
+        img->rgba[i*4 + 0] = (unsigned char)values[i*3 + 0];
+        img->rgba[i*4 + 1] = (unsigned char)values[i*3 + 1];
+        img->rgba[i*4 + 2] = (unsigned char)values[i*3 + 2];
+        img->rgba[i*4 + 3] = 255;
+    }
+    free(values);
+    return 1;
+}
+
+// Parses "name=path[@WxH][#RRGGBB]" and loads the image
+int loadEntry(Image *img, char *spec)
+{
+    char *path = strchr(spec, '=');
+    char *size, *key;
+    char *data;
+    long fileSize;
+    int ok, i;
+
+    if(!path) return 0;
+    *path++ = 0;
+    if(strlen(spec) == 0 || strlen(spec) >= PACK_NAME_LEN) {
+        fprintf(stderr, "mkpack: bad entry name '%s'\n", spec);
+        return 0;
+    }
+    strcpy(img->name, spec);
+
+    if((key = strchr(path, '#')) != NULL) {
+        unsigned int rgb;
+        *key++ = 0;
+        if(sscanf(key, "%6x", &rgb) != 1) return 0;
+        img->hasKey = 1;
+        img->key[0] = (rgb >> 16) & 0xFF;
+        img->key[1] = (rgb >> 8) & 0xFF;
+        img->key[2] = rgb & 0xFF;
+    }
+    if((size = strchr(path, '@')) != NULL) {
+        *size++ = 0;
+        if(sscanf(size, "%dx%d", &img->width, &img->height) != 2) return 0;
+    }
+
+    data = readFile(path, &fileSize);
+    if(!data) {
+        fprintf(stderr, "mkpack: cannot read %s\n", path);
+        return 0;
+    }
+    if(fileSize > 2 && data[0] == 'P' && (data[1] == '3' || data[1] == '6')) ok = loadPPM(img, data, fileSize);
+    else ok = loadIntArray(img, data);
+    free(data);
+
+    if(!ok) {
+        fprintf(stderr, "mkpack: cannot decode %s (legacy sources need @WxH unless square)\n", path);
+        return 0;
+    }
+    if(!isPow2(img->width) || !isPow2(img->height)) {
+        fprintf(stderr, "mkpack: %s is %dx%d, sizes must be powers of two\n", path, img->width, img->height);
+        return 0;
+    }
+
+    if(img->hasKey) {
+        for(i = 0; i < img->width * img->height; i++) {
+            unsigned char *t = &img->rgba[i*4];
+            if(t[0] == img->key[0] && t[1] == img->key[1] && t[2] == img->key[2]) t[3] = 0;
+        }
+    }
+    return 1;
+}
+
+void writeU32(FILE *f, uint32_t v)
+{
+    fputc(v & 0xFF, f);
+    fputc((v >> 8) & 0xFF, f);
+    fputc((v >> 16) & 0xFF, f);
+    fputc((v >> 24) & 0xFF, f);
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *out;
+    int count = argc - 2, i;
+    uint32_t offset;
+
+    if(argc < 3 || count > MAX_ENTRIES) {
+        fprintf(stderr, "usage: %s out.pak name=path[@WxH][#RRGGBB] ...\n", argv[0]);
+        return 1;
+    }
+    for(i = 0; i < count; i++) {
+        if(!loadEntry(&images[i], argv[i + 2])) return 1;
+    }
+
+    out = fopen(argv[1], "wb");
+    if(!out) {
+        fprintf(stderr, "mkpack: cannot write %s\n", argv[1]);
+        return 1;
+    }
+
+    // Header and directory, then each image at the next aligned offset
+    fwrite(PACK_MAGIC, 1, 8, out);
+    writeU32(out, PACK_VERSION);
+    writeU32(out, (uint32_t)count);
+    offset = sizeof(PackHeader) + count * sizeof(PackEntry);
+    for(i = 0; i < count; i++) {
+        offset = (offset + PACK_ALIGN - 1) & ~(uint32_t)(PACK_ALIGN - 1);
+        fwrite(images[i].name, 1, PACK_NAME_LEN, out);
+        writeU32(out, (uint32_t)images[i].width);
+        writeU32(out, (uint32_t)images[i].height);
+        writeU32(out, offset);
+        writeU32(out, images[i].hasKey ? PACK_FLAG_ALPHA : 0);
+        offset += (uint32_t)images[i].width * images[i].height * 4;
+    }
+    for(i = 0; i < count; i++) {
+        while(ftell(out) % PACK_ALIGN) fputc(0, out);
+        fwrite(images[i].rgba, 4, (size_t)images[i].width * images[i].height, out);
+        printf("%-16s %4dx%-4d%s\n", images[i].name, images[i].width, images[i].height, images[i].hasKey ? " (keyed)" : "");
+    }
+
+    fclose(out);
+    return 0;
+}
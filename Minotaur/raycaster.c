@@ -1,914 +1,4624 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <GL/glut.h>
-#include <math.h>
-#include <time.h>
-#include "Textures/T_1.ppm"
-#include "Textures/T_2.ppm"
-#include "Textures/T_3.ppm"
-#include "Textures/T_4.ppm"
-#include "Textures/start.ppm"
-#include "Textures/win.ppm"
-#include "Textures/intro.ppm"
-
-#define PI 3.1415926535
-#define P2 PI/2
-#define P3 3*PI/2
-#define DR 0.0174533 // Degree to radian conversion
-#define MAX_KEYS 5 // Maximum number of keys
-
-// Player state variables
-float px, py, pdx, pdy, pa;
-
-// Game state variables
-int keyStates[256] = {0}; // Keyboard input handler
-int gameStarted = 0; // 0: Start Screen, 1: Game Running
-int gameWon = 0; // 0: Not won, 1: Win Screen
-int keysCollected = 0; // Current number of keys picked up
-int keysRequired = 0; // Number of keys needed to win
-int gameIntro = 0; // 0: Game, 1: Intro Screen
-int playerPassedExitCheck = 0; // Flag set when player touches the door
-
-float depthBuffer[1024]; // Stores distance to the closest wall for each vertical line
-
-// Sprite structure for key
-typedef struct {
-    float x;
-    float y;
-    int active;
-} Sprite;
-
-Sprite keySprites[MAX_KEYS];
-
-// MATH
-
-float degToRad(float a) { return a*PI/180.0; }
-float FixAng(float a) { if(a>2*PI){ a-=2*PI;} if(a<0){ a+=2*PI;} return a; }
-
-float dist(float ax, float ay, float bx, float by)
-{
-    return sqrtf((bx-ax)*(bx-ax) + (by-ay)*(by-ay));
-}
-
-#define CHECK_WHITE_PIXEL(r, g, b) (r == 255 && g == 255 && b == 255)
-
-// SCREEN RENDERING (2D)
-
-void drawStartScreen()
-{
-    int x, y;
-    for(y=0; y<512; y++)
-    {
-        for(x=0; x<1024; x++)
-        {
-            int pixel = (y * 1024 + x) * 3;
-            
-            if(pixel >= 0 && pixel < 1024*512*3 - 2)
-            {
-                int red   = start[pixel+0];
-                int green = start[pixel+1];
-                int blue  = start[pixel+2];
-                
-                if(!CHECK_WHITE_PIXEL(red, green, blue)) 
-                {
-                    glPointSize(1);
-                    glColor3ub((GLubyte)red, (GLubyte)green, (GLubyte)blue);
-                    glBegin(GL_POINTS);
-                    glVertex2i(x, y);
-                    glEnd();
-                }
-            }
-        }
-    }
-}
-
-void drawIntroScreen()
-{
-    int x, y;
-    for(y=0; y<512; y++)
-    {
-        for(x=0; x<1024; x++)
-        {
-            int pixel = (y * 1024 + x) * 3;
-            
-            if(pixel >= 0 && pixel < 1024*512*3 - 2)
-            {
-                int red   = intro[pixel+0];
-                int green = intro[pixel+1];
-                int blue  = intro[pixel+2];
-                
-                if(!CHECK_WHITE_PIXEL(red, green, blue)) 
-                {
-                    glPointSize(1);
-                    glColor3ub((GLubyte)red, (GLubyte)green, (GLubyte)blue);
-                    glBegin(GL_POINTS);
-                    glVertex2i(x, y);
-                    glEnd();
-                }
-            }
-        }
-    }
-}
-
-void drawWinScreen()
-{
-    int x, y;
-    for(y=0; y<512; y++)
-    {
-        for(x=0; x<1024; x++)
-        {
-            int pixel = (y * 1024 + x) * 3;
-            
-            if(pixel >= 0 && pixel < 1024*512*3 - 2)
-            {
-                int red   = win[pixel+0];
-                int green = win[pixel+1];
-                int blue  = win[pixel+2];
-                
-                if(!CHECK_WHITE_PIXEL(red, green, blue))
-                {
-                    glPointSize(1);
-                    glColor3ub((GLubyte)red, (GLubyte)green, (GLubyte)blue);
-                    glBegin(GL_POINTS);
-                    glVertex2i(x, y);
-                    glEnd();
-                }
-            }
-        }
-    }
-}
-
-// MAP GENERATION & COLLISION
-
-int mapX=16, mapY=16, mapS=64; // Map dimensions
-// Dynamic map arrays
-int map[16*16]; 
-int mapFloor[16*16];
-int mapCeiling[16*16]; 
-
-void initializeFloorCeiling() {
-    int i;
-    for(i = 0; i < mapX * mapY; i++) {
-        mapFloor[i] = 2; // Texture T_2
-        mapCeiling[i] = 3; // Texture T_3
-    }
-}
-
-// Initializes the map
-void initializeMap()
-{
-    int x, y;
-    for (y = 0; y < mapY; y++) {
-        for (x = 0; x < mapX; x++) {
-            map[y * mapX + x] = 1;
-        }
-    }
-}
-
-// Maze generation
-void generateMaze()
-{
-    int stackX[256];
-    int stackY[256];
-    int top = 0;
-    int x, y, nx, ny, i, dir;
-    int dx[] = {0, 0, 2, -2}; // Directions (2 steps)
-    int dy[] = {2, -2, 0, 0}; 
-
-    // 1. Initialize all cells to walls
-    initializeMap();
-
-    // 2. Start from an initial point
-    x = 1; y = 1;
-    map[y * mapX + x] = 0; // Carve out the starting cell
-
-    // Push starting cell to stack
-    stackX[top] = x;
-    stackY[top] = y;
-    top++;
-
-    while (top > 0) 
-    {
-        // Peek current cell
-        x = stackX[top-1];
-        y = stackY[top-1];
-
-        // 3. Randomly shuffle directions
-        int directions[4] = {0, 1, 2, 3};
-        for (i = 0; i < 4; i++) {
-            int j = rand() % 4;
-            int temp = directions[i];
-            directions[i] = directions[j];
-            directions[j] = temp;
-        }
-
-        int foundNeighbor = 0;
-        // 4. Try all shuffled directions
-        for (i = 0; i < 4; i++) {
-            dir = directions[i];
-            nx = x + dx[dir];
-            ny = y + dy[dir];
-
-            // Check boundaries (must be an interior cell and not the border)
-            if (nx > 0 && nx < mapX - 1 && ny > 0 && ny < mapY - 1) 
-            {
-                int next_mp = ny * mapX + nx;
-                
-                // If the next cell is a wall, carve a path
-                if (map[next_mp] == 1) 
-                {
-                    // Carve out cell in between
-                    map[(y + dy[dir] / 2) * mapX + (x + dx[dir] / 2)] = 0;
-                    // Carve out new cell
-                    map[next_mp] = 0;
-
-                    // Push new cell
-                    stackX[top] = nx;
-                    stackY[top] = ny;
-                    top++;
-                    foundNeighbor = 1;
-                    break; // Move to new cell
-                }
-            }
-        }
-        
-        if (!foundNeighbor) {
-            // Backtrack
-            top--;
-        }
-    }
-}
-
-// Place the door (4)
-void placeDoor() {
-    int rx, ry, mp;
-    int found = 0;
-    
-    while (!found) {
-        
-        // Randomly pick one of the four edges (x=0, x=15, y=0, y=15)
-        int edge = rand() % 4;
-        
-        if (edge == 0) { // Top border
-            rx = (rand() % (mapX - 2)) + 1;
-            ry = 0;
-        } else if (edge == 1) { // Bottom border
-            rx = (rand() % (mapX - 2)) + 1;
-            ry = mapY - 1;
-        } else if (edge == 2) { // Left border
-            rx = 0;
-            ry = (rand() % (mapY - 2)) + 1;
-        } else { // Right border
-            rx = mapX - 1;
-            ry = (rand() % (mapY - 2)) + 1;
-        }
-
-        mp = ry * mapX + rx;
-        
-        int nx = rx, ny = ry;
-        if (edge == 0) ny = 1; // Cell below
-        if (edge == 1) ny = mapY - 2; // Cell above
-        if (edge == 2) nx = 1; // Cell to the right
-        if (edge == 3) nx = mapX - 2; // Cell to the left
-        
-        // Check the spot is not the player spawn
-        if (rx != 1 || ry != 1) {
-            // Check if the adjacent interior cell is a walkable (0)
-            if (map[ny * mapX + nx] == 0) {
-                map[mp] = 4; // Place door
-                found = 1;
-            }
-        }
-    }
-}
-
-
-// Key spawn function
-void findRandomEmptySpot(float *outX, float *outY) {
-    int rx, ry, mp;
-    int found = 0;
-    while (!found) {
-        // Map coord RNG
-        rx = (rand() % (mapX - 2)) + 1;
-        ry = (rand() % (mapY - 2)) + 1;
-        
-        mp = ry * mapX + rx;
-        
-        // Check if the cell is walkable (value 0)
-        if (map[mp] == 0 && !(rx == 1 && ry == 1)) {
-            // Check if another key is already here
-            int i;
-            int keyOverlap = 0;
-            for(i = 0; i < MAX_KEYS; i++) {
-                int keyMx = (int)(keySprites[i].x) >> 6;
-                int keyMy = (int)(keySprites[i].y) >> 6;
-                if(keySprites[i].active && keyMx == rx && keyMy == ry) {
-                    keyOverlap = 1;
-                    break;
-                }
-            }
-            
-            if (!keyOverlap) {
-                *outX = rx * mapS + mapS / 2.0f;
-                *outY = ry * mapS + mapS / 2.0f;
-                found = 1;
-            }
-        }
-    }
-}
-
-
-int checkCollision(float x, float y)
-{
-    int mx = (int)(x) >> 6;
-    int my = (int)(y) >> 6;
-    int mp = my * mapX + mx;
-
-    if(mp < 0 || mp >= mapX * mapY) return 1;
-
-    if(map[mp] == 1) return 1; // Regular wall
-    
-    // Door logic
-    if(map[mp] == 4) {
-        if(keysCollected >= keysRequired) {
-            // Player has enough keys
-            playerPassedExitCheck = 1; 
-            return 0; // Win state trigger
-        } else {
-            return 1; // Blocked
-        }
-    }
-
-    return 0;
-}
-
-// HUD
-
-void drawText(char *string, int x, int y, float r, float g, float b)
-{
-    glColor3f(r, g, b);
-    glRasterPos2i(x, y);
-    while (*string) {
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, *string++);
-    }
-}
-
-
-// RAYCASTING & RENDERING
-void drawRays3D()
-{
-    int r,mx,my,mp,dof,y,i;
-    float rx,ry,ra,xo,yo,disT;
-
-    ra = pa - DR*30.0f;
-    ra = FixAng(ra); 
-
-    for(r=0;r<128;r++) 
-    {
-        float disH, hx, hy; 
-        int hMapValue;
-        float aTan;
-        float disV, vx, vy; 
-        int vMapValue;
-        float nTan;
-        float ca;
-        float lineH;
-        float lineOff;
-        float shade;
-        int texX;
-        int wallType;
-
-        // Horizontal Check 
-        dof=0; disH=1e6f; hMapValue=0; aTan = -1.0f / tanf(ra);
-        if(ra > PI) { ry = (((int)py>>6)<<6) - 0.0001f; rx = (py - ry) * aTan + px; yo = -64; xo = -yo * aTan; }
-        else { ry = (((int)py>>6)<<6) + 64; rx = (py - ry) * aTan + px; yo = 64; xo = -yo * aTan; }
-        if(fabsf(ra - 0.0f) < 1e-6 || fabsf(ra - PI) < 1e-6) { rx = px; ry = py; dof = 8; } 
-        while(dof < 8) 
-        {
-            mx = (int)(rx) >> 6; my = (int)(ry) >> 6; mp = my * mapX + mx;
-            if(mp >= 0 && mp < mapX*mapY) {
-                if(map[mp] == 1 || map[mp] == 4) { 
-                    hx = rx; hy = ry; disH = dist(px,py,hx,hy); 
-                    hMapValue = map[mp]; 
-                    dof = 8; 
-                } else { rx += xo; ry += yo; dof++; }
-            } else { rx += xo; ry += yo; dof++; } 
-        }
-
-        // Vertical Check
-        dof = 0; disV = 1e6f; vMapValue=0; nTan = -tanf(ra);
-        if(ra > P2 && ra < P3) { rx = (((int)px>>6)<<6) - 0.0001f; ry = (px - rx) * nTan + py; xo = -64; yo = -xo * nTan; }
-        else { rx = (((int)px>>6)<<6) + 64; ry = (px - rx) * nTan + py; xo = 64; yo = -xo * nTan; }
-        if(fabsf(ra - P2) < 1e-6 || fabsf(ra - P3) < 1e-6) { rx = px; ry = py; dof = 8; } 
-
-        while(dof < 8)
-        {
-            mx = (int)(rx) >> 6; my = (int)(ry) >> 6; mp = my * mapX + mx;
-            if(mp >= 0 && mp < mapX*mapY) {
-                if(map[mp] == 1 || map[mp] == 4) { 
-                    vx = rx; vy = ry; disV = dist(px,py,vx,vy);
-                    vMapValue = map[mp]; 
-                    dof = 8; 
-                } else { rx += xo; ry += yo; dof++; }
-            } else { rx += xo; ry += yo; dof++; } 
-        }
-
-        // Final Distance Selection & Fish-eye Correction
-        if(disV < disH) { rx = vx; ry = vy; disT = disV; wallType = vMapValue; shade = 1.0f; }
-        else { rx = hx; ry = hy; disT = disH; wallType = hMapValue; shade = 0.7f; }
-
-        ca = pa - ra; 
-        ca = FixAng(ca); 
-        disT *= cosf(ca); 
-
-        // Store distance in the depth buffer
-        for(i = r*8; i < (r+1)*8 && i < 1024; i++) {
-            depthBuffer[i] = disT;
-        }
-
-        // Calculate wall height and vertical offset
-        lineH = (mapS * 512.0f) / disT;
-        if(lineH > 512) lineH = 512;
-        lineOff = 256.0f - lineH/2.0f;
-
-        // Draw Ceiling (T_3)
-        for(y = 0; y < (int)lineOff; y++)
-        {
-            float dy = 256.0f - y;
-            float ceilingDist;
-            float wx, wy;
-            int localX, localY;
-            int ceilingTexX, ceilingTexY;
-            int ceilingPixel;
-            
-            if(fabsf(dy) < 1e-6f) continue;
-            
-            float currentRa = ra;
-            float caFix = cosf(pa - currentRa); 
-            ceilingDist = (mapS * 512.0f) / (dy * 2.0f * caFix);
-            
-            wx = px + cosf(currentRa) * ceilingDist;
-            wy = py + sinf(currentRa) * ceilingDist;
-            
-            localX = ((int)wx) % 32;
-            localY = ((int)wy) % 32;
-            if(localX < 0) localX += 32;
-            if(localY < 0) localY += 32;
-            
-            ceilingTexX = localX;
-            ceilingTexY = localY;
-            
-            ceilingPixel = (ceilingTexY * 32 + ceilingTexX) * 3;
-            
-            if(ceilingPixel >= 0 && ceilingPixel < 32*32*3 - 2)
-            {
-                int red   = T_3[ceilingPixel+0];
-                int green = T_3[ceilingPixel+1];
-                int blue  = T_3[ceilingPixel+2];
-                
-                glColor3ub((GLubyte)red, (GLubyte)green, (GLubyte)blue);
-                glPointSize(8); 
-                glBegin(GL_POINTS);
-                glVertex2i(r*8, y);
-                glEnd();
-            }
-        }
-
-        // Wall Texture Calculation
-        if(disV < disH) {
-            texX = ((int)ry) % 32;
-            if(texX < 0) texX += 32;
-            shade = 1.0f;
-        } else {
-            texX = ((int)rx) % 32;
-            if(texX < 0) texX += 32;
-            shade = 0.7f; 
-        }
-        
-        // Draw Wall
-        for(y = 0; y < (int)lineH; y++)
-        {
-            int texY = (y * 32) / (int)lineH;
-            int pixel;
-            int red, green, blue;
-            
-            if(texY < 0) texY = 0; if(texY >= 32) texY = 31;
-            if(texX < 0) texX = 0; if(texX >= 32) texX = 31;
-
-            pixel = (texY * 32 + texX) * 3;
-            if(pixel >= 0 && pixel < 32*32*3 - 2)
-            {
-                if(wallType == 4) {
-                    red   = (int)(T_4[pixel+0] * shade);
-                    green = (int)(T_4[pixel+1] * shade);
-                    blue  = (int)(T_4[pixel+2] * shade);
-                } else {
-                    red   = (int)(T_1[pixel+0] * shade);
-                    green = (int)(T_1[pixel+1] * shade);
-                    blue  = (int)(T_1[pixel+2] * shade);
-                }
-
-                glPointSize(8);
-                glColor3ub((GLubyte)red, (GLubyte)green, (GLubyte)blue);
-                glBegin(GL_POINTS);
-                glVertex2i(r*8, (int)(y + lineOff));
-                glEnd();
-            }
-        }
-
-        // Draw Floor (T_2)
-        for(y = (int)(lineH + lineOff); y < 512; y++)
-        {
-            float dy = y - 256.0f;
-            float floorDist;
-            float wx, wy;
-            int localX, localY;
-            int floorTexX, floorTexY;
-            int floorPixel;
-            
-            if(fabsf(dy) < 1e-6f) continue;
-            
-            float currentRa = ra;
-            float caFix = cosf(pa - currentRa);
-            floorDist = (mapS * 512.0f) / (dy * 2.0f * caFix);
-            
-            wx = px + cosf(currentRa) * floorDist;
-            wy = py + sinf(currentRa) * floorDist;
-            
-            localX = ((int)wx) % 32;
-            localY = ((int)wy) % 32;
-            if(localX < 0) localX += 32;
-            if(localY < 0) localY += 32;
-            
-            floorTexX = localX;
-            floorTexY = localY;
-            
-            floorPixel = (floorTexY * 32 + floorTexX) * 3;
-            
-            if(floorPixel >= 0 && floorPixel < 32*32*3 - 2)
-            {
-                int red   = T_2[floorPixel+0];
-                int green = T_2[floorPixel+1];
-                int blue  = T_2[floorPixel+2];
-                
-                glColor3ub((GLubyte)red, (GLubyte)green, (GLubyte)blue);
-                glPointSize(8);
-                glBegin(GL_POINTS);
-                glVertex2i(r*8, y);
-                glEnd();
-            }
-        }
-        
-        ra += DR*0.5f;
-        ra = FixAng(ra);
-    }
-    
-}
-
-// SPRITE RENDERING (KEYS)
-void drawSprite(Sprite *s, const unsigned char *tex, int texWidth, int texHeight)
-{
-    float spx, spy;
-    float spriteAngle;
-    float spriteDist;
-    float spriteHeight;
-    float spriteWidth;
-    int spriteScreenX;
-    int startX, endX, startY, endY;
-    int x, y; 
-    
-    if(!s->active) return;
-    
-    spx = s->x - px;
-    spy = s->y - py;
-    
-    spriteAngle = atan2f(spy, spx) - pa;
-    while(spriteAngle < -PI) spriteAngle += 2*PI;
-    while(spriteAngle > PI) spriteAngle -= 2*PI;
-    
-    if(spriteAngle < -DR * 30.0f || spriteAngle > DR * 30.0f) return;
-    
-    spriteDist = sqrtf(spx*spx + spy*spy);
-    if(spriteDist < 1) return;
-    
-    spriteHeight = (mapS * 512.0f) / spriteDist;
-    if(spriteHeight > 512) spriteHeight = 512;
-    
-    spriteWidth = spriteHeight; 
-    
-    spriteScreenX = (int)(512 + (spriteAngle / (DR * 0.5f) * 8)); 
-    
-    startX = spriteScreenX - (int)(spriteWidth / 2);
-    endX = spriteScreenX + (int)(spriteWidth / 2);
-    startY = 256 - (int)(spriteHeight / 2);
-    endY = 256 + (int)(spriteHeight / 2);
-    
-    if(startX < 0) startX = 0;
-    if(endX > 1024) endX = 1024;
-    if(startY < 0) startY = 0;
-    if(endY > 512) endY = 512;
-    
-    for(x = startX; x < endX; x++)
-    {
-        if(x < 0 || x >= 1024) continue;
-        
-        if(spriteDist >= depthBuffer[x]) continue;
-        
-        for(y = startY; y < endY; y++)
-        {
-            float nx = (float)(x - startX) / spriteWidth;
-            float ny = (float)(y - startY) / spriteHeight;
-            
-            int drawPixel = 0;
-            
-            // Key head
-            float headCenterY = 0.25f;
-            float headRadius = 0.15f;
-            float distToHead = sqrtf((nx - 0.5f)*(nx - 0.5f) + (ny - headCenterY)*(ny - headCenterY));
-            if(distToHead < headRadius) drawPixel = 1;
-            
-            // Key hole
-            float holeCenterY = 0.25f;
-            float holeRadius = 0.06f;
-            float distToHole = sqrtf((nx - 0.5f)*(nx - 0.5f) + (ny - holeCenterY)*(ny - holeCenterY));
-            if(distToHole < holeRadius) drawPixel = 0;
-            
-            // Key shaft
-            if(nx > 0.43f && nx < 0.57f && ny > 0.35f && ny < 0.75f) drawPixel = 1;
-            
-            // Key teeth
-            if(nx > 0.43f && nx < 0.50f && ny > 0.70f && ny < 0.78f) drawPixel = 1;
-            if(nx > 0.43f && nx < 0.50f && ny > 0.82f && ny < 0.90f) drawPixel = 1;
-            
-            if(drawPixel)
-            {
-                glColor3f(1.0f, 0.84f, 0.0f);
-                glPointSize(1);
-                glBegin(GL_POINTS);
-                glVertex2i(x, y);
-                glEnd();
-            }
-        }
-    }
-}
-
-// LOGIC
-
-void updateMovement()
-{
-    float walkSpeed = 3.0f;
-    float rotSpeed = 0.05f;
-    float newX, newY;
-    int moved = 0;
-    int i;
-    
-    if(!gameStarted || gameWon || gameIntro) return;
-    
-    newX = px;
-    newY = py;
-
-    // Rotation
-    if(keyStates['a']) {
-        pa -= rotSpeed;
-        if(pa < 0) { pa += 2*PI; }
-        pdx = cosf(pa)*5.0f;
-        pdy = sinf(pa)*5.0f;
-        moved = 1;
-    }
-    if(keyStates['d']) {
-        pa += rotSpeed;
-        if(pa > 2*PI) { pa -= 2*PI; }
-        pdx = cosf(pa)*5.0f;
-        pdy = sinf(pa)*5.0f;
-        moved = 1;
-    }
-
-    // Movement
-    if(keyStates['w']) {
-        newX += cosf(pa) * walkSpeed;
-        newY += sinf(pa) * walkSpeed;
-        moved = 1;
-    }
-    if(keyStates['s']) {
-        newX -= cosf(pa) * walkSpeed;
-        newY -= sinf(pa) * walkSpeed;
-        moved = 1;
-    }
-
-    // Collision check and update player
-    if(!checkCollision(newX, newY))
-    {
-        px = newX;
-        py = newY;
-    }
-    
-    // Check for keys
-    for(i = 0; i < keysRequired; i++)
-    {
-        if(keySprites[i].active)
-        {
-            float distToKey = dist(px, py, keySprites[i].x, keySprites[i].y);
-            if(distToKey < 20) // Distance check
-            {
-                keySprites[i].active = 0;
-                keysCollected++;
-            }
-        }
-    }
-
-    // Exit check
-    if(playerPassedExitCheck)
-    {
-        // Give a small delay before the win screen appears
-        if (keysCollected >= keysRequired) {
-            gameWon = 1; 
-        } else {
-             playerPassedExitCheck = 0; // Should not happen due to checkCollision, but for safety
-        }
-    }
-    
-    if(moved || gameWon) {
-        glutPostRedisplay();
-    }
-}
-
-void display()
-{
-    int i;
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    
-    if(gameWon)
-    {
-        drawWinScreen();
-    }
-    else if(!gameStarted)
-    {
-        drawStartScreen();
-    }
-    else if(gameIntro)
-    {
-        drawIntroScreen();
-    }
-    else // (Maze + Keys)
-    {
-        // Draw black background (floor/ceiling fallback)
-        glColor3f(0.2f, 0.2f, 0.2f);
-        glBegin(GL_QUADS);
-        glVertex2i(0, 0);
-        glVertex2i(1024, 0);
-        glVertex2i(1024, 512);
-        glVertex2i(0, 512);
-        glEnd();
-        
-        drawRays3D();
-        
-        // Draw key sprite
-        for(i = 0; i < keysRequired; i++)
-        {
-            drawSprite(&keySprites[i], NULL, 32, 32); 
-        }
-        
-
-        // Draw HUD
-        char hudText[50];
-        sprintf(hudText, "Keys: %d / %d", keysCollected, keysRequired);
-        drawText(hudText, 10, 500, 1.0f, 1.0f, 0.0f); // (Keys collected/required)
-        
-        // Door Status
-        if (keysCollected < keysRequired) {
-            drawText("FIND THE KEYS TO ESCAPE (W, A, S, D)", 150, 500, 1.0f, 0.0f, 0.0f); // (Locked)
-        } else {
-            drawText("EXIT IS OPEN! PRESS W TO ESCAPE.", 150, 500, 0.0f, 1.0f, 0.0f); // (Unlocked)
-        }
-    }
-    
-    glutSwapBuffers();
-}
-
-void resetGame() {
-    float keyX, keyY;
-    int i; 
-    
-    // Generate a new random map
-    generateMaze(); 
-    placeDoor();    
-    initializeFloorCeiling(); 
-
-    // Reset player
-    px = 1 * mapS + mapS/2;
-    py = 1 * mapS + mapS/2;
-    pa = 0;
-    pdx = cosf(pa) * 5.0f;
-    pdy = sinf(pa) * 5.0f;
-    
-    keysCollected = 0;
-    playerPassedExitCheck = 0;
-    
-    // Re-initialize key states
-    keysRequired = (rand() % MAX_KEYS) + 1; // Keys required (1-5)
-
-    for(i = 0; i < keysRequired; i++)
-    {
-        findRandomEmptySpot(&keyX, &keyY);
-        keySprites[i].x = keyX;
-        keySprites[i].y = keyY;
-        keySprites[i].active = 1;
-    }
-    // Deactivate unused slots
-    for(i = keysRequired; i < MAX_KEYS; i++) {
-        keySprites[i].active = 0;
-    }
-}
-
-
-void keyDown(unsigned char key, int x, int y)
-{
-    if(gameWon)
-    {
-        // Reset game state after winning
-        gameWon = 0;
-        gameStarted = 0;
-        gameIntro = 0;
-        
-        resetGame(); // Regenerate map, keys, and player position
-        
-        glutPostRedisplay();
-        return;
-    }
-    
-    if(!gameStarted)
-    {
-        // Start Screen > Intro Screen
-        gameStarted = 1;
-        gameIntro = 1; // Set intro state active
-        glutPostRedisplay();
-    }
-    else if(gameIntro)
-    {
-        // Intro Screen > Game
-        gameIntro = 0; // Set intro state inactive, entering main game loop
-        glutPostRedisplay();
-    }
-    
-    // Store key state for continuous movement
-    keyStates[key] = 1;
-}
-
-void keyUp(unsigned char key, int x, int y)
-{
-    keyStates[key] = 0;
-}
-
-void timer(int value)
-{
-    updateMovement();
-    glutTimerFunc(16, timer, 0);
-}
-
-void resize(int w, int h)
-{
-    glViewport(0, 0, w, h);
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    gluOrtho2D(0, 1024, 512, 0);
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-}
-
-void init()
-{
-    glClearColor(0.3f, 0.3f, 0.3f, 0);
-    gluOrtho2D(0, 1024, 512, 0); 
-
-    resetGame(); // Initial game setup
-}
-
-int main(int argc, char* argv[])
-{
-    // RNG
-    srand(time(NULL));
-
-    glutInit(&argc, argv);
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
-    glutInitWindowSize(1024, 512);
-    
-    // Window Dimensions
-    int screenWidth = glutGet(GLUT_SCREEN_WIDTH);
-    int screenHeight = glutGet(GLUT_SCREEN_HEIGHT);
-    int windowX = (screenWidth - 1024) / 2;
-    int windowY = (screenHeight - 512) / 2;
-    
-    glutInitWindowPosition(windowX, windowY);
-    glutCreateWindow("RayCaster");
-    
-    init();
-    
-    glutDisplayFunc(display);
-    glutKeyboardFunc(keyDown);
-    glutKeyboardUpFunc(keyUp);
-    glutReshapeFunc(resize);
-    glutTimerFunc(0, timer, 0);
-    
-    glutMainLoop();
-    return 0;
-}
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#endif
+#ifndef HEADLESS
+#include <GL/glut.h>
+#include <GL/freeglut_ext.h> // glutGetProcAddress
+#include <GL/glext.h>
+#endif
+#include "assetpack.h"
+
+#define PI 3.1415926535
+#define P2 PI/2
+#define P3 3*PI/2
+#define DR 0.0174533 // Degree to radian conversion
+#define MAX_KEYS 5 // Maximum number of keys
+#define MAX_THREADS 64 // Upper bound on render threads
+
+#ifndef GL_UNSIGNED_INT_8_8_8_8_REV
+#define GL_UNSIGNED_INT_8_8_8_8_REV 0x8367 // Missing from GL 1.1 headers
+#endif
+
+// Player state variables
+float px, py, pdx, pdy, pa;
+float prevX, prevY, prevA; // Pose before the last simulation tick
+float viewX, viewY, viewA; // Pose frames are drawn from, interpolated between ticks
+
+// Game state variables
+int keyStates[256] = {0}; // Keyboard input handler
+int gameStarted = 0; // 0: Start Screen, 1: Game Running
+int gameWon = 0; // 0: Not won, 1: Win Screen
+int gameCaught = 0; // 1: A minotaur reached the player, lose screen
+int keysCollected = 0; // Current number of keys picked up
+int keysRequired = 0; // Number of keys needed to win
+int gameIntro = 0; // 0: Game, 1: Intro Screen
+int playerPassedExitCheck = 0; // Flag set when player touches the door
+int minotaurOption = -1; // -minotaurs: pursuers per round, -1: by maze size (see PURSUIT)
+
+// Render settings (see setScreenSize() and applyRenderScale())
+int screenW = 1024, screenH = 512; // Window size; the HUD and splash screens are laid out in it
+int renderW = 1024, renderH = 512; // Framebuffer size: the window size scaled by renderScale
+int columnW = 8; // Pixel width of one ray column
+int numRays = 128; // Rays cast per frame
+float fov = DR*60.0f; // Horizontal field of view
+float renderScale = 1.0f; // Dynamic resolution factor, minRenderScale..1
+float minRenderScale = 0.25f; // Lowest scale the dynamic resolution controller may pick
+float frameBudgetMs = 1000.0f / 60.0f; // Render time target per frame, 0 disables scaling
+int fpsCap = 0; // Frame rate limit, 0: as fast as the buffer swap allows
+int showStats = 0; // Print frame and tick timings once a second
+
+float *depthBuffer = NULL; // Stores distance to the closest wall for each vertical line
+
+// Sprite bitmap, column-major (texel (x, y) at x*height + y) so a screen column reads
+// one contiguous run. Transparent texels have alpha 0, and top/bottom bound the opaque
+// texels of each column so drawing never visits empty rows.
+typedef struct {
+    uint32_t *texels;
+    int width, height;
+    int *top; // First opaque row of each column
+    int *bottom; // One past the last opaque row (equal to top: column is empty)
+    uint8_t *indices; // Palette index of each texel, indexed colour mode only
+} SpriteImage;
+
+SpriteImage keyImage;
+SpriteImage minotaurImage;
+
+int mapX=16, mapY=16, mapS=64; // Map dimensions
+#define MAX_MAP_SIZE 8192 // Largest map side accepted from the command line
+
+// Map layers, sized by allocMap() and indexed by cell (y * mapX + x). Ray traversal
+// and collision only ask whether a cell blocks, so that is a bitmap (bit i of word
+// i / 32) kept apart from the byte layers holding what the cell is.
+uint32_t *mapSolid = NULL;
+uint8_t *map = NULL; // 0 open, 1 wall, 4 door
+uint8_t *mapFloor = NULL;
+uint8_t *mapCeiling = NULL;
+uint8_t *mapFlow = NULL; // Step towards the player from each cell, FLOW_* (see PURSUIT)
+uint16_t *flowStamp = NULL; // Search that last reached each cell
+int *flowQueue = NULL; // Cells the current search reached, in order
+int mapVersion = 0; // Bumped whenever cells change after generation, for copies of the map
+
+#define ENTITY_KEY 0 // Picked up on contact, counts towards keysRequired
+#define ENTITY_PROP 1 // Decoration only
+#define ENTITY_MINOTAUR 2 // Follows mapFlow towards the player, catching them on contact
+
+// Billboard in the world, e.g. a key
+typedef struct {
+    float x;
+    float y;
+    int active;
+    int kind; // ENTITY_*
+    const SpriteImage *image;
+    int cell; // Map cell holding it
+    int next; // Next entity in the same cell, -1 at the end
+    int prev; // Previous entity in the same cell, -1 at the head
+} Sprite;
+
+// MATH & TIMING
+
+float degToRad(float a) { return a*PI/180.0; }
+float FixAng(float a) { if(a>2*PI){ a-=2*PI;} if(a<0){ a+=2*PI;} return a; }
+
+float dist(float ax, float ay, float bx, float by)
+{
+    return sqrtf((bx-ax)*(bx-ax) + (by-ay)*(by-ay));
+}
+
+// Monotonic wall clock in milliseconds
+double nowMs()
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart * 1000.0 / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+#endif
+}
+
+// Gives up the CPU for about ms milliseconds
+void sleepMs(double ms)
+{
+    if(ms <= 0) return;
+#ifdef _WIN32
+    Sleep((DWORD)ms);
+#else
+    usleep((useconds_t)(ms * 1000.0));
+#endif
+}
+
+void *allocOrDie(void *old, size_t bytes)
+{
+    void *p = realloc(old, bytes);
+    if(!p) {
+        fprintf(stderr, "out of memory (%lu bytes)\n", (unsigned long)bytes);
+        exit(1);
+    }
+    return p;
+}
+
+// RANDOM
+
+// PCG32 (pcg-random.org): 64-bit state, 32-bit output. Everything that shapes a round
+// draws from gameRng, which resetGame() seeds from gameSeed, so a seed reproduces
+// the maze, door, keys and key count exactly on any platform.
+typedef struct {
+    uint64_t state;
+    uint64_t inc;
+} Rng;
+
+Rng gameRng;
+unsigned long gameSeed = 0; // Seed of the current round, printed at the start of each one
+
+uint32_t rngNext(Rng *rng)
+{
+    uint64_t old = rng->state;
+    uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+    uint32_t rot = (uint32_t)(old >> 59);
+    rng->state = old * 6364136223846793005ULL + rng->inc;
+    return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+}
+
+void rngSeed(Rng *rng, uint64_t seed)
+{
+    rng->state = 0;
+    rng->inc = 1442695040888963407ULL; // Fixed odd stream
+    rngNext(rng);
+    rng->state += seed;
+    rngNext(rng);
+}
+
+// Uniform in [0, n) without modulo bias
+uint32_t rngRange(Rng *rng, uint32_t n)
+{
+    uint32_t threshold = (0u - n) % n; // 2^32 mod n
+    uint32_t r;
+    do r = rngNext(rng); while(r < threshold);
+    return r % n;
+}
+
+// PROFILER
+
+// Per-stage frame timings, compiled in with -DPROFILE. Each frame's stage times go
+// into a ring buffer and a histogram per stage; 'p' toggles an overlay graph of the
+// latest frames, and -profile writes the ring as CSV or, for a .json name, as a
+// Chrome trace (chrome://tracing, Perfetto). Without PROFILE the PROF_ macros
+// expand to nothing, so a normal build makes no extra timer calls.
+#ifdef PROFILE
+enum {
+    PROF_TICKS, PROF_CLEAR, PROF_RAYCAST, PROF_CEILING, PROF_WALLS, PROF_FLOOR, PROF_WIDEN,
+    PROF_SPRITES, PROF_UPLOAD, PROF_HUD, PROF_SWAP, PROF_STAGES
+};
+const char *profStageNames[PROF_STAGES] = {
+    "ticks", "clear", "raycast", "ceiling", "walls", "floor", "widen", "sprites", "upload", "hud", "swap"
+};
+const float profStageColors[PROF_STAGES][3] = {
+    {0.6f, 0.6f, 0.6f}, {0.4f, 0.4f, 1.0f}, {1.0f, 0.3f, 0.3f}, {0.3f, 0.8f, 1.0f},
+    {1.0f, 0.6f, 0.2f}, {0.4f, 1.0f, 0.4f}, {0.8f, 0.4f, 1.0f}, {1.0f, 1.0f, 0.3f},
+    {1.0f, 0.5f, 0.8f}, {1.0f, 1.0f, 1.0f}, {0.2f, 0.6f, 0.4f}
+};
+
+#define PROF_FRAMES 4096 // Frames kept for export, the oldest overwritten
+#define PROF_GRAPH_FRAMES 240 // Latest frames shown by the overlay
+#define PROF_BUCKETS 12 // Histogram: under 1/32 ms, doubling up to 32 ms, then the rest
+
+typedef struct {
+    double start; // Clock when the frame began
+    float frameMs; // Until the next frame began
+    float stageStart[PROF_STAGES]; // First entry into each stage, ms from start
+    float stageMs[PROF_STAGES]; // Total time in each stage (ticks: all of them)
+} ProfFrame;
+
+ProfFrame profFrames[PROF_FRAMES];
+int profFrameCount = 0; // Frames begun; the open one is profFrames[(count - 1) % PROF_FRAMES]
+double profEnter[PROF_STAGES]; // Clock at the last PROF_BEGIN of each stage
+unsigned profHistogram[PROF_STAGES][PROF_BUCKETS];
+int profOverlay = 0; // Draw the graph and legend
+const char *profPath = NULL; // -profile output, NULL: summary only
+
+#define PROF_BEGIN(stage) (profEnter[stage] = nowMs())
+#define PROF_END(stage) profEnd(stage)
+#define PROF_FRAME() profFrame()
+
+ProfFrame *profFrameAt(int index)
+{
+    return &profFrames[index % PROF_FRAMES];
+}
+
+void profEnd(int stage)
+{
+    ProfFrame *f;
+
+    if(profFrameCount == 0) return;
+    f = profFrameAt(profFrameCount - 1);
+    if(f->stageMs[stage] == 0) f->stageStart[stage] = (float)(profEnter[stage] - f->start);
+    f->stageMs[stage] += (float)(nowMs() - profEnter[stage]);
+}
+
+int profBucket(float ms)
+{
+    int b = 0;
+    float edge = 1.0f / 32;
+    while(b < PROF_BUCKETS - 1 && ms >= edge) {
+        b++;
+        edge *= 2;
+    }
+    return b;
+}
+
+// Closes the open frame and begins the next
+void profFrame()
+{
+    double now = nowMs();
+    ProfFrame *f;
+    int i;
+
+    if(profFrameCount > 0) {
+        f = profFrameAt(profFrameCount - 1);
+        f->frameMs = (float)(now - f->start);
+        for(i = 0; i < PROF_STAGES; i++) {
+            if(f->stageMs[i] > 0) profHistogram[i][profBucket(f->stageMs[i])]++;
+        }
+    }
+    f = profFrameAt(profFrameCount++);
+    memset(f, 0, sizeof(*f));
+    f->start = now;
+}
+
+// Average and worst of a stage over the last n closed frames (-1: the whole frame)
+void profStageStats(int stage, int n, float *avg, float *worst)
+{
+    int i, first = profFrameCount - 1 - n;
+    *avg = *worst = 0;
+    if(first < 0) first = 0;
+    if(profFrameCount - 1 - first > PROF_FRAMES - 1) first = profFrameCount - PROF_FRAMES;
+    for(i = first; i < profFrameCount - 1; i++) {
+        ProfFrame *f = profFrameAt(i);
+        float ms = stage < 0 ? f->frameMs : f->stageMs[stage];
+        *avg += ms;
+        if(ms > *worst) *worst = ms;
+    }
+    if(i > first) *avg /= i - first;
+}
+
+// Writes the closed frames still in the ring, then prints the histograms
+void profWrite()
+{
+    int first = profFrameCount > PROF_FRAMES ? profFrameCount - PROF_FRAMES : 0;
+    int i, j, b, trace;
+    FILE *out;
+
+    if(profPath && (out = fopen(profPath, "w")) != NULL)
+    {
+        trace = strlen(profPath) > 5 && !strcmp(profPath + strlen(profPath) - 5, ".json");
+        if(trace) fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        else {
+            fprintf(out, "frame,start_ms,frame_ms");
+            for(j = 0; j < PROF_STAGES; j++) fprintf(out, ",%s_ms", profStageNames[j]);
+            fprintf(out, "\n");
+        }
+        for(i = first; i < profFrameCount - 1; i++)
+        {
+            ProfFrame *f = profFrameAt(i);
+            double us = (f->start - profFrameAt(first)->start) * 1000.0;
+            if(trace) {
+                // Stages nest inside their frame; ticks are summed into one slice
+                fprintf(out, "%s{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.1f,\"dur\":%.1f}",
+                        i > first ? ",\n" : "", us, f->frameMs * 1000.0);
+                for(j = 0; j < PROF_STAGES; j++) {
+                    if(f->stageMs[j] <= 0) continue;
+                    fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.1f,\"dur\":%.1f}",
+                            profStageNames[j], us + f->stageStart[j] * 1000.0, f->stageMs[j] * 1000.0);
+                }
+            } else {
+                fprintf(out, "%d,%.3f,%.3f", i, us / 1000.0, f->frameMs);
+                for(j = 0; j < PROF_STAGES; j++) fprintf(out, ",%.3f", f->stageMs[j]);
+                fprintf(out, "\n");
+            }
+        }
+        if(trace) fprintf(out, "\n]}\n");
+        fclose(out);
+        printf("profile: %d frames written to %s\n", profFrameCount - 1 - first, profPath);
+    }
+
+    printf("profile histogram, frames per bucket (upper edge in ms)\n%-8s", "stage");
+    for(b = 0; b < PROF_BUCKETS - 1; b++) printf(" %6g", (1 << b) / 32.0);
+    printf("   more\n");
+    for(j = 0; j < PROF_STAGES; j++) {
+        printf("%-8s", profStageNames[j]);
+        for(b = 0; b < PROF_BUCKETS; b++) printf(" %6u", profHistogram[j][b]);
+        printf("\n");
+    }
+}
+#else
+#define PROF_BEGIN(stage) ((void)0)
+#define PROF_END(stage) ((void)0)
+#define PROF_FRAME() ((void)0)
+#endif
+
+// FRAMEBUFFER
+
+// Packs a colour as R,G,B,A bytes (matches GL_RGBA + GL_UNSIGNED_INT_8_8_8_8_REV)
+#define PACK_RGB(r, g, b) ((uint32_t)(r) | ((uint32_t)(g) << 8) | ((uint32_t)(b) << 16) | 0xFF000000u)
+
+// Column-major render target: pixel (x, y) is frameBuffer[x * renderH + y].
+// Each ray column is one contiguous run; the transpose happens on upload.
+uint32_t *frameBuffer = NULL;
+
+// Indexed colour mode (-indexed, see PALETTE): the passes draw one palette index per
+// pixel into frameIndex, laid out like frameBuffer, which is filled from it on upload
+int indexedColor = 0;
+uint8_t *frameIndex = NULL;
+uint32_t palette[256]; // PACK_RGB colours
+uint8_t paletteLookup[1 << 15]; // Nearest palette entry for each 5-5-5 colour
+
+uint32_t *frameColumn(int x)
+{
+    return &frameBuffer[x * renderH];
+}
+
+uint8_t *indexColumn(int x)
+{
+    return &frameIndex[x * renderH];
+}
+
+// PACK_RGB colour reduced to 5 bits per channel, red highest
+int color555(uint32_t c)
+{
+    return ((c << 7) & 0x7C00) | ((c >> 6) & 0x3E0) | ((c >> 19) & 0x1F);
+}
+
+// Palette entry closest to a PACK_RGB colour
+uint8_t paletteIndex(uint32_t c)
+{
+    return paletteLookup[color555(c)];
+}
+
+void clearFrame(uint32_t color)
+{
+    int i, count = renderW * renderH;
+    if(indexedColor) {
+        memset(frameIndex, paletteIndex(color), (size_t)count);
+        return;
+    }
+    for(i = 0; i < count; i++) {
+        frameBuffer[i] = color;
+    }
+}
+
+// ASSET PACK
+
+// Textures and splash images come from a binary pack (see assetpack.h, built by mkpack)
+// that is mapped read-only; floor, ceiling and splash texels are used in place.
+// The pack stores little-endian data and is read as such.
+const char *packPath = "minotaur.pak";
+const unsigned char *packData = NULL;
+size_t packSize = 0;
+
+// Maps the whole file read-only; returns NULL on failure
+const unsigned char *mapFile(const char *path, size_t *size)
+{
+#ifdef _WIN32
+    HANDLE file, mapping;
+    LARGE_INTEGER fileSize;
+    const unsigned char *data = NULL;
+
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE) return NULL;
+    if(GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if(mapping) {
+            data = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+        }
+        *size = (size_t)fileSize.QuadPart;
+    }
+    CloseHandle(file);
+    return data;
+#else
+    struct stat st;
+    void *data;
+    int fd = open(path, O_RDONLY);
+
+    if(fd < 0) return NULL;
+    if(fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return NULL;
+    }
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) return NULL;
+    *size = (size_t)st.st_size;
+    return (const unsigned char *)data;
+#endif
+}
+
+const PackEntry *packEntries()
+{
+    return (const PackEntry *)(packData + sizeof(PackHeader));
+}
+
+// Maps the pack and checks that every entry lies inside the file
+int openAssetPack(const char *path)
+{
+    const PackHeader *header;
+    uint32_t i;
+
+    packData = mapFile(path, &packSize);
+    if(!packData) return 0;
+
+    header = (const PackHeader *)packData;
+    if(packSize < sizeof(PackHeader) || memcmp(header->magic, PACK_MAGIC, 8) != 0 ||
+       header->version != PACK_VERSION ||
+       header->count > (packSize - sizeof(PackHeader)) / sizeof(PackEntry)) return 0;
+
+    for(i = 0; i < header->count; i++)
+    {
+        const PackEntry *e = &packEntries()[i];
+        if(e->width == 0 || (e->width & (e->width - 1)) || e->height == 0 || (e->height & (e->height - 1)) ||
+           e->offset % 4 != 0 || e->offset > packSize ||
+           (uint64_t)e->width * e->height * 4 > packSize - e->offset) return 0;
+    }
+    return 1;
+}
+
+const PackEntry *findAsset(const char *name)
+{
+    uint32_t i, count = ((const PackHeader *)packData)->count;
+    for(i = 0; i < count; i++) {
+        if(strncmp(packEntries()[i].name, name, PACK_NAME_LEN) == 0) return &packEntries()[i];
+    }
+    return NULL;
+}
+
+const uint32_t *assetTexels(const PackEntry *e)
+{
+    return (const uint32_t *)(packData + e->offset);
+}
+
+// TEXTURES
+
+#define TEX_REPEAT 32.0f // World units covered by one repeat of a wall, floor or ceiling texture
+#define MAX_MIPS 16 // Mip levels kept per texture (enough for 32768 texels per side)
+
+// Square power-of-two texture of packed texels (PACK_RGB layout)
+typedef struct {
+    const uint32_t *texels;
+    int size; // Texels per side
+    int shift; // log2(size)
+} Texture;
+
+// Texture with its mip chain: mips[i] is a box-filtered copy of mips[0] at size >> i,
+// down to 1x1. Distant surfaces sample a small level that stays in cache.
+typedef struct {
+    Texture mips[MAX_MIPS];
+    int levels;
+} MipTexture;
+
+// Palette indices of a MipTexture, level for level in the same layout (see PALETTE)
+typedef struct {
+    uint8_t *mips[MAX_MIPS];
+} IndexedMips;
+
+#define SHADE_LEVELS 2
+const float shadeLevels[SHADE_LEVELS] = { 1.0f, 0.7f }; // Walls on vertical / horizontal grid lines
+
+// What a cell looks like: map[] holds the material of a wall cell, mapFloor[] and
+// mapCeiling[] those of its floor and ceiling, and material n is asset T_n. The passes
+// look a material up once per wall hit or floor span, never per pixel, so a level can
+// use any number of textures at the cost of one.
+#define MAX_MATERIALS 256
+#define MATERIAL_WALL 1
+#define MATERIAL_FLOOR 2
+#define MATERIAL_CEILING 3
+#define MATERIAL_DOOR 4
+
+typedef struct {
+    int id; // Its index in materials
+    MipTexture flat; // Row-major, level 0 straight from the pack (floors and ceilings)
+    // Column-major (texel (x, y) at x*size + y) so a wall column is one contiguous
+    // run, and pre-multiplied for each shade level
+    MipTexture wall[SHADE_LEVELS];
+    IndexedMips flatIndices, wallIndices; // Unshaded palette copies, indexed colour only
+} Material;
+
+// Every value has an entry: those with no T_n in the pack share material 1
+Material *materials[MAX_MATERIALS];
+
+uint32_t *allocTexels(int size)
+{
+    uint32_t *texels = (uint32_t *)malloc((size_t)size * size * sizeof(uint32_t));
+    if(!texels) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    return texels;
+}
+
+int loadTexture(const char *name, Texture *tex)
+{
+    const PackEntry *e = findAsset(name);
+    if(!e || e->width != e->height) return 0;
+
+    tex->texels = assetTexels(e);
+    tex->size = (int)e->width;
+    for(tex->shift = 0; (1 << tex->shift) < tex->size; tex->shift++);
+    return 1;
+}
+
+// Fills in levels 1.. from level 0 by averaging 2x2 blocks. The filter is symmetric,
+// so it works the same on row-major and column-major textures.
+void buildMips(MipTexture *tex)
+{
+    int level, x, y, c;
+
+    for(level = 1; level < MAX_MIPS && tex->mips[level - 1].size > 1; level++)
+    {
+        const Texture *src = &tex->mips[level - 1];
+        int size = src->size / 2;
+        uint32_t *texels = allocTexels(size);
+
+        for(y = 0; y < size; y++) {
+            for(x = 0; x < size; x++) {
+                const uint32_t *p = src->texels + (y * 2) * src->size + x * 2;
+                uint32_t texel = 0;
+                for(c = 0; c < 32; c += 8) {
+                    uint32_t sum = ((p[0] >> c) & 0xFF) + ((p[1] >> c) & 0xFF) +
+                                   ((p[src->size] >> c) & 0xFF) + ((p[src->size + 1] >> c) & 0xFF);
+                    texel |= ((sum + 2) >> 2) << c;
+                }
+                texels[y * size + x] = texel;
+            }
+        }
+        tex->mips[level].texels = texels;
+        tex->mips[level].size = size;
+        tex->mips[level].shift = src->shift - 1;
+    }
+    tex->levels = level;
+}
+
+// Mip level for a surface sampled every texelsPerSample level-0 texels
+int mipLevel(const MipTexture *tex, float texelsPerSample)
+{
+    int level = 0;
+    while(texelsPerSample >= 2.0f && level < tex->levels - 1) {
+        texelsPerSample *= 0.5f;
+        level++;
+    }
+    return level;
+}
+
+void packWallTexture(const Texture *src, MipTexture *dst, float shade)
+{
+    int x, y, size = src->size;
+    uint32_t *texels = allocTexels(size);
+
+    for(x = 0; x < size; x++) {
+        for(y = 0; y < size; y++) {
+            uint32_t c = src->texels[y * size + x];
+            texels[x * size + y] = PACK_RGB((int)((c & 0xFF) * shade), (int)(((c >> 8) & 0xFF) * shade),
+                                            (int)(((c >> 16) & 0xFF) * shade));
+        }
+    }
+    dst->mips[0].texels = texels;
+    dst->mips[0].size = size;
+    dst->mips[0].shift = src->shift;
+    buildMips(dst);
+}
+
+// Is value n a material of its own, rather than sharing material 1?
+int hasMaterial(int n)
+{
+    return materials[n]->id == n;
+}
+
+// Loads every T_n in the pack as material n; T_1 to T_4 are required
+void initTextures()
+{
+    char name[PACK_NAME_LEN];
+    Texture tex;
+    int i, s;
+
+    // T_1 to T_4 (wall, floor, ceiling, door) must be there and square; the others are optional
+    if(!openAssetPack(packPath) || !loadTexture("T_1", &tex) || !loadTexture("T_2", &tex) ||
+       !loadTexture("T_3", &tex) || !loadTexture("T_4", &tex))
+    {
+        fprintf(stderr, "cannot load textures from asset pack '%s' (build it with mkpack, see README)\n", packPath);
+        exit(1);
+    }
+    for(i = 1; i < MAX_MATERIALS; i++)
+    {
+        sprintf(name, "T_%d", i);
+        if(!loadTexture(name, &tex)) continue;
+        materials[i] = (Material *)allocOrDie(NULL, sizeof(Material));
+        memset(materials[i], 0, sizeof(Material));
+        materials[i]->id = i;
+        materials[i]->flat.mips[0] = tex;
+        buildMips(&materials[i]->flat);
+        for(s = 0; s < SHADE_LEVELS; s++) packWallTexture(&tex, &materials[i]->wall[s], shadeLevels[s]);
+    }
+    for(i = 0; i < MAX_MATERIALS; i++) {
+        if(!materials[i]) materials[i] = materials[MATERIAL_WALL];
+    }
+}
+
+#ifndef HEADLESS
+GLuint frameTexture = 0;
+int frameTexW = 0, frameTexH = 0; // Allocated texture size (transposed, powers of two)
+
+int nextPow2(int v)
+{
+    int p = 1;
+    while(p < v) p <<= 1;
+    return p;
+}
+
+void initFrameTexture()
+{
+    // Stored transposed: texture rows are screen columns
+    glGenTextures(1, &frameTexture);
+    glBindTexture(GL_TEXTURE_2D, frameTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+}
+
+// Uploads the whole frame with one texture update and stretches it over the window
+void uploadFrame()
+{
+    float s1, t1;
+
+    glBindTexture(GL_TEXTURE_2D, frameTexture);
+    if(frameTexW < renderH || frameTexH < renderW)
+    {
+        frameTexW = nextPow2(renderH);
+        frameTexH = nextPow2(renderW);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, frameTexW, frameTexH, 0,
+                     GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, NULL);
+    }
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, renderH, renderW,
+                    GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, frameBuffer);
+
+    // Texture s runs down a screen column (y), t runs across columns (x)
+    s1 = (float)renderH / frameTexW;
+    t1 = (float)renderW / frameTexH;
+    glEnable(GL_TEXTURE_2D);
+    glColor3f(1.0f, 1.0f, 1.0f);
+    glBegin(GL_QUADS);
+    glTexCoord2f(0.0f, 0.0f); glVertex2i(0, 0);
+    glTexCoord2f(0.0f, t1); glVertex2i(screenW, 0);
+    glTexCoord2f(s1, t1); glVertex2i(screenW, screenH);
+    glTexCoord2f(s1, 0.0f); glVertex2i(0, screenH);
+    glEnd();
+    glDisable(GL_TEXTURE_2D);
+}
+
+// SCREEN RENDERING (2D)
+
+// Full-screen splash image from the asset pack, uploaded the first time it is shown
+typedef struct {
+    const char *name; // Asset name; transparent texels show the clear colour
+    GLuint texture; // 0 until first shown
+    int missing; // Not in the pack: nothing is drawn
+} SplashScreen;
+
+SplashScreen startSplash = { "start", 0, 0 };
+SplashScreen introSplash = { "intro", 0, 0 };
+SplashScreen winSplash = { "win", 0, 0 };
+SplashScreen caughtSplash = { "caught", 0, 0 };
+
+void loadSplash(SplashScreen *splash)
+{
+    const PackEntry *e = findAsset(splash->name);
+    if(!e) {
+        splash->missing = 1;
+        return;
+    }
+
+    // Uploaded straight from the mapped pack
+    glGenTextures(1, &splash->texture);
+    glBindTexture(GL_TEXTURE_2D, splash->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, e->width, e->height, 0,
+                 GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, assetTexels(e));
+}
+
+void drawSplash(SplashScreen *splash)
+{
+    if(!splash->texture && !splash->missing) loadSplash(splash);
+    if(splash->missing) return;
+
+    glBindTexture(GL_TEXTURE_2D, splash->texture);
+    glEnable(GL_TEXTURE_2D);
+    glEnable(GL_ALPHA_TEST);
+    glAlphaFunc(GL_GREATER, 0.5f);
+    glColor3f(1.0f, 1.0f, 1.0f);
+    glBegin(GL_QUADS);
+    glTexCoord2f(0.0f, 0.0f); glVertex2i(0, 0);
+    glTexCoord2f(1.0f, 0.0f); glVertex2i(screenW, 0);
+    glTexCoord2f(1.0f, 1.0f); glVertex2i(screenW, screenH);
+    glTexCoord2f(0.0f, 1.0f); glVertex2i(0, screenH);
+    glEnd();
+    glDisable(GL_ALPHA_TEST);
+    glDisable(GL_TEXTURE_2D);
+}
+
+void drawStartScreen()
+{
+    drawSplash(&startSplash);
+}
+
+void drawIntroScreen()
+{
+    drawSplash(&introSplash);
+}
+
+void drawWinScreen()
+{
+    drawSplash(&winSplash);
+}
+
+#endif // !HEADLESS
+
+// WORLD LOOKUP
+
+// In endless mode (-endless) the map layers are a window onto an unbounded maze made
+// of CHUNK_CELLS x CHUNK_CELLS chunks: world chunk (cx, cy) lives in slot
+// (cx % CHUNK_SLOTS, cy % CHUNK_SLOTS), so the map wraps and its size never changes.
+// Chunks are generated in the background as the player approaches (CHUNK GENERATION)
+// and a chunk is evicted when a nearer one needs its slot.
+#define CHUNK_SHIFT 5
+#define CHUNK_CELLS (1 << CHUNK_SHIFT) // Cells per chunk side
+#define CHUNK_SLOTS 8 // Window side in chunks, a power of two
+#define CHUNK_RADIUS 3 // Chunks kept loaded around the player's, 2*R+1 <= CHUNK_SLOTS
+#define WORLD_CHUNKS 512 // World side in chunks; bounded so float positions stay precise
+
+enum { CHUNK_IDLE, CHUNK_QUEUED, CHUNK_GENERATING, CHUNK_DONE };
+
+typedef struct {
+    int cx, cy; // World chunk the slot holds or is waiting for (written under chunkLock)
+    int ready; // Cells are in the map layers (main thread only)
+    int job; // CHUNK_*, under chunkLock
+    uint8_t cells[CHUNK_CELLS * CHUNK_CELLS]; // Generator output: the worker's while GENERATING
+} ChunkSlot;
+
+int endless = 0;
+ChunkSlot chunkSlots[CHUNK_SLOTS * CHUNK_SLOTS];
+
+ChunkSlot *chunkSlot(int cx, int cy)
+{
+    return &chunkSlots[(cy & (CHUNK_SLOTS - 1)) * CHUNK_SLOTS + (cx & (CHUNK_SLOTS - 1))];
+}
+
+// Map layer index of world cell (mx, my), or -1 if it is off the map or its chunk is
+// not loaded yet. Never waits: a chunk still being generated just reads as missing.
+int cellIndex(int mx, int my)
+{
+    if(endless) {
+        const ChunkSlot *slot;
+        if(mx < 0 || my < 0) return -1;
+        slot = chunkSlot(mx >> CHUNK_SHIFT, my >> CHUNK_SHIFT);
+        if(!slot->ready || slot->cx != mx >> CHUNK_SHIFT || slot->cy != my >> CHUNK_SHIFT) return -1;
+        return (my & (mapY - 1)) * mapX + (mx & (mapX - 1));
+    }
+    if(mx < 0 || my < 0 || mx >= mapX || my >= mapY) return -1;
+    return my * mapX + mx;
+}
+
+// ENTITIES
+
+// All sprites in the world live in one growable array, bucketed by map cell through
+// an intrusive doubly linked list (cellEntities -> Sprite.next/prev), so pickups,
+// overlap checks and drawing only look at the cells they care about, and moving an
+// entity to another cell is constant time. A sprite is at most a cell wide and
+// stands at its position, so it is only ever seen through rays crossing its cell.
+Sprite *entities = NULL;
+int entityCount = 0, entityCapacity = 0;
+int freeEntity = -1; // Removed slots, chained through next
+int *cellEntities = NULL; // First entity in each map cell, -1 if none
+
+int cellOf(float x, float y)
+{
+    return cellIndex((int)x >> 6, (int)y >> 6);
+}
+
+// Cells crossed by this frame's rays. Each render worker appends to its own list
+// while casting; collectVisibleCells() merges them without duplicates.
+typedef struct {
+    int *cells;
+    int count, capacity;
+} CellList;
+
+CellList rayCells[MAX_THREADS];
+CellList visibleCells;
+uint32_t *cellSeen = NULL; // Bit per cell: in visibleCells
+
+// Drops every entity and sizes the buckets for the current map
+void clearEntities()
+{
+    int i;
+    entityCount = 0;
+    freeEntity = -1;
+    cellEntities = (int *)allocOrDie(cellEntities, (size_t)mapX * mapY * sizeof(int));
+    for(i = 0; i < mapX * mapY; i++) cellEntities[i] = -1;
+
+    visibleCells.count = 0;
+    cellSeen = (uint32_t *)allocOrDie(cellSeen, ((size_t)mapX * mapY + 31) / 32 * sizeof(uint32_t));
+    memset(cellSeen, 0, ((size_t)mapX * mapY + 31) / 32 * sizeof(uint32_t));
+}
+
+// Puts an entity at the head of a cell's list
+void linkEntity(int id, int cell)
+{
+    Sprite *s = &entities[id];
+    s->cell = cell;
+    s->prev = -1;
+    s->next = cellEntities[cell];
+    if(s->next >= 0) entities[s->next].prev = id;
+    cellEntities[cell] = id;
+}
+
+void unlinkEntity(int id)
+{
+    Sprite *s = &entities[id];
+    if(s->prev >= 0) entities[s->prev].next = s->next;
+    else cellEntities[s->cell] = s->next;
+    if(s->next >= 0) entities[s->next].prev = s->prev;
+}
+
+int addEntity(float x, float y, int kind, const SpriteImage *image)
+{
+    Sprite *s;
+    int id = freeEntity;
+
+    if(id >= 0) freeEntity = entities[id].next;
+    else {
+        if(entityCount == entityCapacity) {
+            entityCapacity = entityCapacity ? entityCapacity * 2 : 64;
+            entities = (Sprite *)allocOrDie(entities, entityCapacity * sizeof(Sprite));
+        }
+        id = entityCount++;
+    }
+    s = &entities[id];
+    s->x = x;
+    s->y = y;
+    s->active = 1;
+    s->kind = kind;
+    s->image = image;
+    linkEntity(id, cellOf(x, y));
+    return id;
+}
+
+// Unlinks an entity from its cell and recycles its slot
+void removeEntity(int id)
+{
+    unlinkEntity(id);
+    entities[id].active = 0;
+    entities[id].next = freeEntity;
+    freeEntity = id;
+}
+
+// Moves an entity, relinking it only when it crosses into another cell
+void moveEntity(int id, float x, float y)
+{
+    Sprite *s = &entities[id];
+    int cell = cellOf(x, y);
+
+    s->x = x;
+    s->y = y;
+    if(cell == s->cell) return;
+    unlinkEntity(id);
+    linkEntity(id, cell);
+}
+
+void addCell(CellList *list, int cell)
+{
+    if(list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 256;
+        list->cells = (int *)allocOrDie(list->cells, list->capacity * sizeof(int));
+    }
+    list->cells[list->count++] = cell;
+}
+
+void collectVisibleCells()
+{
+    int w, i;
+
+    // Only last frame's bits are set, so clearing them is cheaper than the whole set
+    for(i = 0; i < visibleCells.count; i++) cellSeen[visibleCells.cells[i] >> 5] = 0;
+    visibleCells.count = 0;
+
+    for(w = 0; w < MAX_THREADS; w++) {
+        for(i = 0; i < rayCells[w].count; i++) {
+            int cell = rayCells[w].cells[i];
+            uint32_t bit = 1u << (cell & 31);
+            if(!(cellSeen[cell >> 5] & bit)) {
+                cellSeen[cell >> 5] |= bit;
+                addCell(&visibleCells, cell);
+            }
+        }
+        rayCells[w].count = 0;
+    }
+}
+
+// MAP GENERATION & COLLISION
+
+int *mazeScratch = NULL; // Generator working space
+
+// Sizes the map layers for mapX x mapY
+void allocMap()
+{
+    size_t cells = (size_t)mapX * mapY;
+
+    mapSolid = (uint32_t *)allocOrDie(mapSolid, (cells + 31) / 32 * sizeof(uint32_t));
+    map = (uint8_t *)allocOrDie(map, cells);
+    mapFloor = (uint8_t *)allocOrDie(mapFloor, cells);
+    mapCeiling = (uint8_t *)allocOrDie(mapCeiling, cells);
+    mapFlow = (uint8_t *)allocOrDie(mapFlow, cells);
+    flowStamp = (uint16_t *)allocOrDie(flowStamp, cells * sizeof(uint16_t));
+    flowQueue = (int *)allocOrDie(flowQueue, cells * sizeof(int));
+    // One int per lattice cell (backtracker stack, Wilson walk) or four per column (Eller)
+    mazeScratch = (int *)allocOrDie(mazeScratch, ((size_t)(mapX / 2) * (mapY / 2) + mapX * 2 + 1) * sizeof(int));
+}
+
+int isSolidCell(int cell)
+{
+    return (mapSolid[cell >> 5] >> (cell & 31)) & 1;
+}
+
+int isSolid(int mx, int my)
+{
+    return isSolidCell(my * mapX + mx);
+}
+
+// Sets a cell's kind and keeps the solidity bitmap in step
+void setCell(int mx, int my, int kind)
+{
+    int cell = my * mapX + mx;
+    map[cell] = (uint8_t)kind;
+    if(kind != 0) mapSolid[cell >> 5] |= 1u << (cell & 31);
+    else mapSolid[cell >> 5] &= ~(1u << (cell & 31));
+}
+
+void initializeFloorCeiling() {
+    int i;
+    for(i = 0; i < mapX * mapY; i++) {
+        mapFloor[i] = MATERIAL_FLOOR;
+        mapCeiling[i] = MATERIAL_CEILING;
+    }
+}
+
+// Initializes the map
+void initializeMap()
+{
+    memset(map, 1, (size_t)mapX * mapY);
+    memset(mapSolid, 0xFF, ((size_t)mapX * mapY + 31) / 32 * sizeof(uint32_t));
+}
+
+// Maze generators. All carve the odd-coordinate lattice of cells inside the border:
+// lattice cell (lx, ly) is map cell (2*lx + 1, 2*ly + 1), and the wall between two
+// neighbours is the cell halfway. They start from a map of solid walls.
+
+int latticeDX[4] = { 0, 0, 1, -1 };
+int latticeDY[4] = { 1, -1, 0, 0 };
+
+// Recursive backtracker (depth-first), iterative with a heap stack: long corridors
+void generateBacktracker(Rng *rng)
+{
+    int top = 0;
+    int x, y, nx, ny, i, dir;
+    int dx[] = {0, 0, 2, -2}; // Directions (2 steps)
+    int dy[] = {2, -2, 0, 0}; 
+    int *stack = mazeScratch; // Cell indices
+
+    // Start from an initial point
+    x = 1; y = 1;
+    setCell(x, y, 0); // Carve out the starting cell
+
+    // Push starting cell to stack
+    stack[top++] = y * mapX + x;
+
+    while (top > 0) 
+    {
+        // Peek current cell
+        x = stack[top-1] % mapX;
+        y = stack[top-1] / mapX;
+
+        // Randomly shuffle directions
+        int directions[4] = {0, 1, 2, 3};
+        for (i = 3; i > 0; i--) {
+            int j = (int)rngRange(rng, i + 1);
+            int temp = directions[i];
+            directions[i] = directions[j];
+            directions[j] = temp;
+        }
+
+        int foundNeighbor = 0;
+        // Try all shuffled directions
+        for (i = 0; i < 4; i++) {
+            dir = directions[i];
+            nx = x + dx[dir];
+            ny = y + dy[dir];
+
+            // Check boundaries (must be an interior cell and not the border)
+            if (nx > 0 && nx < mapX - 1 && ny > 0 && ny < mapY - 1) 
+            {
+                // If the next cell is a wall, carve a path
+                if (isSolid(nx, ny)) 
+                {
+                    // Carve out cell in between
+                    setCell(x + dx[dir] / 2, y + dy[dir] / 2, 0);
+                    // Carve out new cell
+                    setCell(nx, ny, 0);
+
+                    // Push new cell
+                    stack[top++] = ny * mapX + nx;
+                    foundNeighbor = 1;
+                    break; // Move to new cell
+                }
+            }
+        }
+        
+        if (!foundNeighbor) {
+            // Backtrack
+            top--;
+        }
+    }
+}
+
+// Wilson's algorithm: loop-erased random walks from each cell not yet in the maze
+// until they reach it. Uniform over all spanning trees, so no directional bias.
+void generateWilson(Rng *rng)
+{
+    int w = (mapX - 1) / 2, h = (mapY - 1) / 2;
+    int *walk = mazeScratch; // Direction last taken out of each lattice cell
+    int start, x, y, nx, ny, dir;
+
+    setCell(1, 1, 0);
+    for(start = 0; start < w * h; start++)
+    {
+        if(!isSolid(start % w * 2 + 1, start / w * 2 + 1)) continue; // Already in the maze
+
+        // Walk until the maze is reached. Revisiting a cell overwrites its direction,
+        // which erases the loop.
+        x = start % w;
+        y = start / w;
+        while(isSolid(x * 2 + 1, y * 2 + 1))
+        {
+            do {
+                dir = (int)rngRange(rng, 4);
+                nx = x + latticeDX[dir];
+                ny = y + latticeDY[dir];
+            } while(nx < 0 || nx >= w || ny < 0 || ny >= h);
+            walk[y * w + x] = dir;
+            x = nx;
+            y = ny;
+        }
+
+        // Carve the loop-erased path
+        x = start % w;
+        y = start / w;
+        while(isSolid(x * 2 + 1, y * 2 + 1))
+        {
+            dir = walk[y * w + x];
+            setCell(x * 2 + 1, y * 2 + 1, 0);
+            setCell(x * 2 + 1 + latticeDX[dir], y * 2 + 1 + latticeDY[dir], 0);
+            x += latticeDX[dir];
+            y += latticeDY[dir];
+        }
+    }
+}
+
+// Union-find root with path halving
+int findSet(int *parent, int c)
+{
+    while(parent[c] != c) {
+        parent[c] = parent[parent[c]];
+        c = parent[c];
+    }
+    return c;
+}
+
+// Opens cell (x, y) of whatever the generator is carving into
+typedef void (*CarveFn)(void *target, int x, int y);
+
+// Eller's algorithm over a w x h lattice: one row at a time, tracking which cells of
+// the current row are already connected. Needs only 4*w ints of scratch, however
+// tall the maze, which also makes it the chunk generator for endless mode.
+void ellerMaze(Rng *rng, int w, int h, int *scratch, CarveFn carve, void *target)
+{
+    int *parent = scratch; // Sets of the current row, by column
+    int *next = parent + w; // Sets of the row below
+    int *mark = next + w; // Per root: has a passage down / first column in the row below
+    int *down = mark + w; // Column gets a passage down
+    int x, y, a, b;
+
+    for(x = 0; x < w; x++) parent[x] = x;
+
+    for(y = 0; y < h; y++)
+    {
+        int my = y * 2 + 1, last = y == h - 1;
+
+        for(x = 0; x < w; x++) carve(target, x * 2 + 1, my);
+
+        // Join neighbours from different sets at random; on the last row, all of them
+        for(x = 0; x + 1 < w; x++)
+        {
+            a = findSet(parent, x);
+            b = findSet(parent, x + 1);
+            if(a != b && (last || (rngNext(rng) & 1))) {
+                parent[b] = a;
+                carve(target, x * 2 + 2, my);
+            }
+        }
+        if(last) break;
+
+        // Every set continues down at least once
+        for(x = 0; x < w; x++) mark[x] = 0;
+        for(x = 0; x < w; x++) {
+            down[x] = rngNext(rng) & 1;
+            if(down[x]) mark[findSet(parent, x)] = 1;
+        }
+        for(x = 0; x < w; x++) {
+            a = findSet(parent, x);
+            if(!mark[a]) {
+                down[x] = 1;
+                mark[a] = 1;
+            }
+        }
+
+        // Cells reached from above keep their set, rebased on its first such column;
+        // the rest start alone
+        for(x = 0; x < w; x++) mark[x] = -1;
+        for(x = 0; x < w; x++)
+        {
+            if(down[x]) {
+                a = findSet(parent, x);
+                if(mark[a] < 0) mark[a] = x;
+                next[x] = mark[a];
+                carve(target, x * 2 + 1, my + 1);
+            } else next[x] = x;
+        }
+        for(x = 0; x < w; x++) parent[x] = next[x];
+    }
+}
+
+void carveMap(void *target, int x, int y)
+{
+    (void)target;
+    setCell(x, y, 0);
+}
+
+void generateEller(Rng *rng)
+{
+    ellerMaze(rng, (mapX - 1) / 2, (mapY - 1) / 2, mazeScratch, carveMap, NULL);
+}
+
+typedef struct {
+    const char *name;
+    void (*generate)(Rng *rng);
+} MazeAlgorithm;
+
+MazeAlgorithm mazeAlgorithms[] = {
+    { "backtracker", generateBacktracker },
+    { "wilson", generateWilson },
+    { "eller", generateEller },
+};
+#define MAZE_ALGORITHMS ((int)(sizeof(mazeAlgorithms) / sizeof(mazeAlgorithms[0])))
+int mazeAlgorithm = 0; // Index into mazeAlgorithms, picked with -maze
+
+// Open cells in breadth-first order from the spawn, and each cell's walking distance
+// from it (-1 for walls and unreachable cells). Rebuilt with every maze, so placement
+// picks from known candidates instead of probing the map at random. Since the list
+// is in BFS order, cells at least N steps out are a suffix of it.
+int *openCells = NULL;
+int openCount = 0;
+int *spawnDist = NULL;
+
+#define KEY_SPAWN_FRACTION 4 // Keys lie at least 1/4 of the farthest distance from the spawn
+#define KEY_SPACING 3 // Cells between keys (Manhattan) when the maze has room
+
+void measureFromSpawn()
+{
+    int cells = mapX * mapY, head = 0, i, d;
+    int step[4];
+
+    step[0] = 1; step[1] = -1; step[2] = mapX; step[3] = -mapX;
+    openCells = (int *)allocOrDie(openCells, (size_t)cells * sizeof(int));
+    spawnDist = (int *)allocOrDie(spawnDist, (size_t)cells * sizeof(int));
+    for(i = 0; i < cells; i++) spawnDist[i] = -1;
+
+    // The border is always solid, so neighbours never leave the map
+    openCount = 0;
+    openCells[openCount++] = mapX + 1;
+    spawnDist[mapX + 1] = 0;
+    while(head < openCount)
+    {
+        int cell = openCells[head++];
+        for(d = 0; d < 4; d++) {
+            int n = cell + step[d];
+            if(spawnDist[n] < 0 && !isSolidCell(n)) {
+                spawnDist[n] = spawnDist[cell] + 1;
+                openCells[openCount++] = n;
+            }
+        }
+    }
+}
+
+// Maze generation
+void generateMaze()
+{
+    // Initialize all cells to walls, then carve
+    initializeMap();
+    mazeAlgorithms[mazeAlgorithm].generate(&gameRng);
+    measureFromSpawn();
+}
+
+// Border cell of the n-th door candidate, walking the top, bottom, left and right
+// edges in turn; returns the number of candidates when n is out of range
+int doorCandidate(int n, int *rx, int *ry)
+{
+    int count = 0, x, y;
+
+    for(x = 1; x < mapX - 1; x++) {
+        if(spawnDist[mapX + x] >= 0 && count++ == n) { *rx = x; *ry = 0; return -1; }
+        if(spawnDist[(mapY - 2) * mapX + x] >= 0 && count++ == n) { *rx = x; *ry = mapY - 1; return -1; }
+    }
+    for(y = 1; y < mapY - 1; y++) {
+        if(spawnDist[y * mapX + 1] >= 0 && count++ == n) { *rx = 0; *ry = y; return -1; }
+        if(spawnDist[y * mapX + mapX - 2] >= 0 && count++ == n) { *rx = mapX - 1; *ry = y; return -1; }
+    }
+    return count;
+}
+
+// Place the door (4) in a border cell next to a reachable open cell. Cell (1, 1) is
+// always open, so there is at least one candidate.
+void placeDoor() {
+    int rx, ry;
+    int count = doorCandidate(-1, &rx, &ry);
+
+    doorCandidate((int)rngRange(&gameRng, count), &rx, &ry);
+    setCell(rx, ry, 4); // Place door
+}
+
+// Is another key within KEY_SPACING cells of this one?
+int nearKey(int cell)
+{
+    int i;
+    for(i = 0; i < entityCount; i++) {
+        Sprite *s = &entities[i];
+        if(s->active && s->kind == ENTITY_KEY &&
+           abs(s->cell % mapX - cell % mapX) + abs(s->cell / mapX - cell / mapX) < KEY_SPACING) return 1;
+    }
+    return 0;
+}
+
+// Index in openCells of the first cell at least 'steps' from the spawn, never the
+// spawn itself; openCount if there is none
+int firstOpenCellAt(int steps)
+{
+    int lo = 1, hi = openCount;
+    while(lo < hi) {
+        int mid = (lo + hi) / 2;
+        if(spawnDist[openCells[mid]] < steps) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Key spawn function: an empty open cell far enough from the spawn and the other
+// keys, relaxing both when the maze is too small. Scans from a random start, so it
+// takes at most two passes over the open cells; returns 0 when every open cell is
+// already taken.
+int findRandomEmptySpot(float *outX, float *outY) {
+    int lo = firstOpenCellAt(spawnDist[openCells[openCount - 1]] / KEY_SPAWN_FRACTION);
+    int pass, from, count, start, k;
+
+    for(pass = 0; pass < 2; pass++)
+    {
+        from = pass ? 1 : lo; // Index 0 is the spawn
+        count = openCount - from;
+        if(count <= 0) continue;
+        start = (int)rngRange(&gameRng, count);
+        for(k = 0; k < count; k++)
+        {
+            int mp = openCells[from + (start + k) % count];
+            // Skip cells that already hold an entity
+            if(cellEntities[mp] >= 0 || (!pass && nearKey(mp))) continue;
+            *outX = mp % mapX * mapS + mapS / 2.0f;
+            *outY = mp / mapX * mapS + mapS / 2.0f;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+int checkCollision(float x, float y)
+{
+    int cell = x < 0 || y < 0 ? -1 : cellIndex((int)x >> 6, (int)y >> 6);
+
+    if(cell < 0) return 1; // Off the map or not loaded yet
+    if(!isSolidCell(cell)) return 0;
+
+    // Door logic
+    if(map[cell] == 4) {
+        if(keysCollected >= keysRequired) {
+            // Player has enough keys
+            playerPassedExitCheck = 1; 
+            return 0; // Win state trigger
+        } else {
+            return 1; // Blocked
+        }
+    }
+
+    return 1; // Regular wall
+}
+
+// CHUNK GENERATION
+
+// One background thread turns queued slots into cells. The main thread queues and
+// collects with trylock, so a busy generator never stalls a frame; a chunk that is
+// not ready simply draws and collides as a wall.
+//
+// Each chunk is a perfect Eller's maze over its own 16x16 lattice, seeded from the
+// round seed and its coordinates. It owns the wall column and row on its -x and -y
+// sides and opens them at seeded rows, so the seams come out the same whichever
+// neighbour was generated first, and regenerating an evicted chunk rebuilds it exactly.
+pthread_mutex_t chunkLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t chunkWork = PTHREAD_COND_INITIALIZER; // Signalled when a slot is queued
+pthread_cond_t chunkIdle = PTHREAD_COND_INITIALIZER; // Signalled when a slot is done
+int chunkThreadStarted = 0;
+#define CHUNK_LOADS_PER_TICK 2 // Finished chunks copied into the map per tick
+int chunkFocusX, chunkFocusY; // Player's chunk: queued slots nearest to it go first
+unsigned long chunkSeed; // Round seed, under chunkLock
+int chunkSync = 0; // Generate chunks as they are queued (replays): no timing dependence
+
+void chunkRngSeed(Rng *rng, unsigned long seed, int cx, int cy, uint64_t stream)
+{
+    rngSeed(rng, (seed + stream) * 0x9E3779B97F4A7C15ULL ^ (uint64_t)cx * 0xC2B2AE3D27D4EB4FULL ^ (uint64_t)cy);
+}
+
+void carveChunk(void *target, int x, int y)
+{
+    ((uint8_t *)target)[y * CHUNK_CELLS + x] = 0;
+}
+
+void generateChunk(uint8_t *cells, unsigned long seed, int cx, int cy)
+{
+    int scratch[CHUNK_CELLS * 2]; // ellerMaze needs 4 ints per lattice column
+    Rng rng;
+    int i, k;
+
+    chunkRngSeed(&rng, seed, cx, cy, 0);
+    memset(cells, 1, CHUNK_CELLS * CHUNK_CELLS);
+    ellerMaze(&rng, CHUNK_CELLS / 2, CHUNK_CELLS / 2, scratch, carveChunk, cells);
+
+    // Seam openings into the -x and -y neighbours; none at the edge of the world
+    for(i = 0; i < 2; i++) {
+        if(cx > 0 && (i == 0 || (rngNext(&rng) & 1))) {
+            k = (int)rngRange(&rng, CHUNK_CELLS / 2);
+            cells[(k * 2 + 1) * CHUNK_CELLS] = 0;
+        }
+        if(cy > 0 && (i == 0 || (rngNext(&rng) & 1))) {
+            k = (int)rngRange(&rng, CHUNK_CELLS / 2);
+            cells[k * 2 + 1] = 0;
+        }
+    }
+}
+
+void *chunkWorkerMain(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&chunkLock);
+    for(;;)
+    {
+        ChunkSlot *best = NULL;
+        int i, bestDist = 0, cx, cy;
+        unsigned long seed;
+
+        for(i = 0; i < CHUNK_SLOTS * CHUNK_SLOTS; i++)
+        {
+            ChunkSlot *slot = &chunkSlots[i];
+            int d = abs(slot->cx - chunkFocusX) + abs(slot->cy - chunkFocusY);
+            if(slot->job == CHUNK_QUEUED && (!best || d < bestDist)) {
+                best = slot;
+                bestDist = d;
+            }
+        }
+        if(!best) {
+            pthread_cond_wait(&chunkWork, &chunkLock);
+            continue;
+        }
+
+        best->job = CHUNK_GENERATING;
+        cx = best->cx;
+        cy = best->cy;
+        seed = chunkSeed;
+        pthread_mutex_unlock(&chunkLock);
+
+        generateChunk(best->cells, seed, cx, cy);
+
+        pthread_mutex_lock(&chunkLock);
+        best->job = CHUNK_DONE;
+        pthread_cond_broadcast(&chunkIdle);
+    }
+    return NULL;
+}
+
+// Copies a generated chunk into the map window and scatters its keys. Collected keys
+// come back if the chunk is evicted and regenerated later.
+void loadChunk(ChunkSlot *slot)
+{
+    int x, y, baseX = slot->cx * CHUNK_CELLS, baseY = slot->cy * CHUNK_CELLS;
+    Rng rng;
+
+    for(y = 0; y < CHUNK_CELLS; y++) {
+        for(x = 0; x < CHUNK_CELLS; x++) {
+            setCell((baseX + x) & (mapX - 1), (baseY + y) & (mapY - 1), slot->cells[y * CHUNK_CELLS + x]);
+        }
+    }
+    slot->ready = 1;
+    mapVersion++;
+
+    chunkRngSeed(&rng, chunkSeed, slot->cx, slot->cy, 1);
+    if(rngNext(&rng) & 1) {
+        x = (int)rngRange(&rng, CHUNK_CELLS / 2) * 2 + 1;
+        y = (int)rngRange(&rng, CHUNK_CELLS / 2) * 2 + 1;
+        addEntity((baseX + x) * mapS + mapS / 2.0f, (baseY + y) * mapS + mapS / 2.0f, ENTITY_KEY, &keyImage);
+    }
+}
+
+// Drops the entities of a loaded chunk before its slot is reused
+void evictChunk(ChunkSlot *slot)
+{
+    int x, y;
+
+    for(y = 0; y < CHUNK_CELLS; y++) {
+        for(x = 0; x < CHUNK_CELLS; x++) {
+            int cell = cellIndex(slot->cx * CHUNK_CELLS + x, slot->cy * CHUNK_CELLS + y);
+            while(cellEntities[cell] >= 0) removeEntity(cellEntities[cell]);
+        }
+    }
+    slot->ready = 0;
+}
+
+// Queues the chunks around the player that are missing and loads finished ones.
+// Called every tick; returns at once if the generator holds the lock.
+void updateChunks()
+{
+    int pcx = ((int)px >> 6) >> CHUNK_SHIFT, pcy = ((int)py >> 6) >> CHUNK_SHIFT;
+    int cx, cy, i, queued = 0, loaded = 0;
+
+    if(chunkSync) pthread_mutex_lock(&chunkLock);
+    else if(pthread_mutex_trylock(&chunkLock) != 0) return;
+    chunkFocusX = pcx;
+    chunkFocusY = pcy;
+
+    for(i = 0; i < CHUNK_SLOTS * CHUNK_SLOTS && loaded < CHUNK_LOADS_PER_TICK; i++) {
+        ChunkSlot *slot = &chunkSlots[i];
+        if(slot->job == CHUNK_DONE) {
+            loaded++;
+            loadChunk(slot);
+            slot->job = CHUNK_IDLE;
+        }
+    }
+
+    for(cy = pcy - CHUNK_RADIUS; cy <= pcy + CHUNK_RADIUS; cy++)
+    {
+        for(cx = pcx - CHUNK_RADIUS; cx <= pcx + CHUNK_RADIUS; cx++)
+        {
+            ChunkSlot *slot = chunkSlot(cx, cy);
+            if(cx < 0 || cy < 0 || cx >= WORLD_CHUNKS || cy >= WORLD_CHUNKS) continue;
+            if(slot->cx == cx && slot->cy == cy && (slot->ready || slot->job != CHUNK_IDLE)) continue;
+            if(slot->job == CHUNK_GENERATING) continue; // Still busy with the chunk it replaces
+
+            if(slot->ready) evictChunk(slot);
+            slot->cx = cx;
+            slot->cy = cy;
+            if(chunkSync) {
+                generateChunk(slot->cells, chunkSeed, cx, cy);
+                loadChunk(slot);
+                continue;
+            }
+            slot->job = CHUNK_QUEUED;
+            queued = 1;
+        }
+    }
+
+    if(queued) pthread_cond_signal(&chunkWork);
+    pthread_mutex_unlock(&chunkLock);
+}
+
+// Starts a round in endless mode: empties the window and loads the chunks around the
+// player right away, so the first frame is complete. The only place that waits.
+void startEndless(int startCX, int startCY)
+{
+    int cx, cy, i;
+
+    if(!chunkThreadStarted) {
+        pthread_t thread;
+        if(pthread_create(&thread, NULL, chunkWorkerMain, NULL) != 0) {
+            fprintf(stderr, "cannot start chunk generator thread\n");
+            exit(1);
+        }
+        pthread_detach(thread);
+        chunkThreadStarted = 1;
+    }
+
+    pthread_mutex_lock(&chunkLock);
+    for(i = 0; i < CHUNK_SLOTS * CHUNK_SLOTS; i++) {
+        while(chunkSlots[i].job == CHUNK_GENERATING) pthread_cond_wait(&chunkIdle, &chunkLock);
+        chunkSlots[i].job = CHUNK_IDLE;
+        chunkSlots[i].ready = 0;
+        chunkSlots[i].cx = chunkSlots[i].cy = -1;
+    }
+    chunkSeed = gameSeed;
+
+    for(cy = startCY - CHUNK_RADIUS; cy <= startCY + CHUNK_RADIUS; cy++) {
+        for(cx = startCX - CHUNK_RADIUS; cx <= startCX + CHUNK_RADIUS; cx++) {
+            ChunkSlot *slot = chunkSlot(cx, cy);
+            slot->cx = cx;
+            slot->cy = cy;
+            generateChunk(slot->cells, chunkSeed, cx, cy);
+            loadChunk(slot);
+        }
+    }
+    pthread_mutex_unlock(&chunkLock);
+}
+
+// HUD
+
+#ifndef HEADLESS
+void drawText(char *string, int x, int y, float r, float g, float b)
+{
+    glColor3f(r, g, b);
+    glRasterPos2i(x, y);
+    while (*string) {
+        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, *string++);
+    }
+}
+#else
+// 5x7 glyphs for the HUD strings, one byte per row (bit 4 is the leftmost pixel)
+const char hudGlyphChars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789:/(),!.";
+const unsigned char hudGlyphs[][7] = {
+    {0x0E,0x11,0x11,0x1F,0x11,0x11,0x11}, {0x1E,0x11,0x11,0x1E,0x11,0x11,0x1E}, // A B
+    {0x0E,0x11,0x10,0x10,0x10,0x11,0x0E}, {0x1E,0x11,0x11,0x11,0x11,0x11,0x1E}, // C D
+    {0x1F,0x10,0x10,0x1E,0x10,0x10,0x1F}, {0x1F,0x10,0x10,0x1E,0x10,0x10,0x10}, // E F
+    {0x0E,0x11,0x10,0x17,0x11,0x11,0x0F}, {0x11,0x11,0x11,0x1F,0x11,0x11,0x11}, // G H
+    {0x0E,0x04,0x04,0x04,0x04,0x04,0x0E}, {0x07,0x02,0x02,0x02,0x02,0x12,0x0C}, // I J
+    {0x11,0x12,0x14,0x18,0x14,0x12,0x11}, {0x10,0x10,0x10,0x10,0x10,0x10,0x1F}, // K L
+    {0x11,0x1B,0x15,0x15,0x11,0x11,0x11}, {0x11,0x11,0x19,0x15,0x13,0x11,0x11}, // M N
+    {0x0E,0x11,0x11,0x11,0x11,0x11,0x0E}, {0x1E,0x11,0x11,0x1E,0x10,0x10,0x10}, // O P
+    {0x0E,0x11,0x11,0x11,0x15,0x12,0x0D}, {0x1E,0x11,0x11,0x1E,0x14,0x12,0x11}, // Q R
+    {0x0F,0x10,0x10,0x0E,0x01,0x01,0x1E}, {0x1F,0x04,0x04,0x04,0x04,0x04,0x04}, // S T
+    {0x11,0x11,0x11,0x11,0x11,0x11,0x0E}, {0x11,0x11,0x11,0x11,0x11,0x0A,0x04}, // U V
+    {0x11,0x11,0x11,0x15,0x15,0x15,0x0A}, {0x11,0x11,0x0A,0x04,0x0A,0x11,0x11}, // W X
+    {0x11,0x11,0x0A,0x04,0x04,0x04,0x04}, {0x1F,0x01,0x02,0x04,0x08,0x10,0x1F}, // Y Z
+    {0x0E,0x11,0x13,0x15,0x19,0x11,0x0E}, {0x04,0x0C,0x04,0x04,0x04,0x04,0x0E}, // 0 1
+    {0x0E,0x11,0x01,0x02,0x04,0x08,0x1F}, {0x1F,0x02,0x04,0x02,0x01,0x11,0x0E}, // 2 3
+    {0x02,0x06,0x0A,0x12,0x1F,0x02,0x02}, {0x1F,0x10,0x1E,0x01,0x01,0x11,0x0E}, // 4 5
+    {0x06,0x08,0x10,0x1E,0x11,0x11,0x0E}, {0x1F,0x01,0x02,0x04,0x08,0x08,0x08}, // 6 7
+    {0x0E,0x11,0x11,0x0E,0x11,0x11,0x0E}, {0x0E,0x11,0x11,0x0F,0x01,0x02,0x0C}, // 8 9
+    {0x00,0x0C,0x0C,0x00,0x0C,0x0C,0x00}, {0x00,0x01,0x02,0x04,0x08,0x10,0x00}, // : /
+    {0x02,0x04,0x08,0x08,0x08,0x04,0x02}, {0x08,0x04,0x02,0x02,0x02,0x04,0x08}, // ( )
+    {0x00,0x00,0x00,0x00,0x0C,0x04,0x08}, {0x04,0x04,0x04,0x04,0x04,0x00,0x04}, // , !
+    {0x00,0x00,0x00,0x00,0x00,0x0C,0x0C}                                        // .
+};
+
+// Software stand-in for the GLUT bitmap font: (x, y) is the baseline, glyphs are drawn 2x
+void drawText(char *string, int x, int y, float r, float g, float b)
+{
+    uint32_t color = PACK_RGB((int)(r*255), (int)(g*255), (int)(b*255));
+    int row, col, sx, sy;
+
+    for(; *string; string++, x += 12)
+    {
+        char c = *string;
+        const char *found;
+        if(c >= 'a' && c <= 'z') c -= 'a' - 'A';
+        if(c == ' ' || (found = strchr(hudGlyphChars, c)) == NULL) continue;
+
+        for(col = 0; col < 5; col++)
+        {
+            for(sx = x + col*2; sx < x + col*2 + 2; sx++)
+            {
+                uint32_t *column;
+                if(sx < 0 || sx >= renderW) continue;
+                column = frameColumn(sx);
+                for(row = 0; row < 7; row++)
+                {
+                    if(!(hudGlyphs[found - hudGlyphChars][row] & (0x10 >> col))) continue;
+                    for(sy = y - 14 + row*2; sy < y - 12 + row*2; sy++) {
+                        if(sy >= 0 && sy < renderH) column[sy] = color;
+                    }
+                }
+            }
+        }
+    }
+}
+#endif
+
+void drawHUD()
+{
+    char hudText[50];
+    if (endless) {
+        sprintf(hudText, "Keys: %d", keysCollected);
+        drawText(hudText, 10, screenH - 12, 1.0f, 1.0f, 0.0f);
+        drawText("ENDLESS MAZE (W, A, S, D)", 150, screenH - 12, 1.0f, 1.0f, 1.0f);
+        return;
+    }
+
+    sprintf(hudText, "Keys: %d / %d", keysCollected, keysRequired);
+    drawText(hudText, 10, screenH - 12, 1.0f, 1.0f, 0.0f); // (Keys collected/required)
+    
+    // Door Status
+    if (keysCollected < keysRequired) {
+        drawText("FIND THE KEYS TO ESCAPE (W, A, S, D)", 150, screenH - 12, 1.0f, 0.0f, 0.0f); // (Locked)
+    } else {
+        drawText("EXIT IS OPEN! PRESS W TO ESCAPE.", 150, screenH - 12, 0.0f, 1.0f, 0.0f); // (Unlocked)
+    }
+}
+
+#ifndef HEADLESS
+// The pack's "caught" image, or a line of text when it has none
+void drawCaughtScreen()
+{
+    drawSplash(&caughtSplash);
+    if(caughtSplash.missing) {
+        drawText("THE MINOTAUR CAUGHT YOU!", screenW / 2 - 120, screenH / 2, 1.0f, 0.0f, 0.0f);
+        drawText("PRESS ANY KEY FOR A NEW MAZE.", screenW / 2 - 140, screenH / 2 + 30, 1.0f, 1.0f, 1.0f);
+    }
+}
+#endif
+
+#ifdef PROFILE
+#define PROF_GRAPH_MS 33.3f // Frame time at the top of the graph; a line marks half of it
+
+// Stacked stage times of the latest frames, one framebuffer column each, in the
+// top left corner (drawn into the framebuffer, so it scales with the resolution)
+void profDrawGraph()
+{
+    int height = renderH / 4, width = renderW / 2;
+    int x, y, i, j;
+    float scale = height / PROF_GRAPH_MS;
+
+    if(width > PROF_GRAPH_FRAMES) width = PROF_GRAPH_FRAMES;
+    for(x = 0; x < width; x++)
+    {
+        uint32_t *column = frameColumn(x);
+        int frame = profFrameCount - 1 - width + x, top = height;
+
+        for(y = 0; y < height; y++) column[y] = PACK_RGB(0, 0, 0);
+        column[height / 2] = PACK_RGB(90, 90, 90);
+        if(frame < 0 || frame < profFrameCount - PROF_FRAMES) continue;
+
+        // Untimed part of the frame in grey behind the stages
+        for(y = height - (int)(profFrameAt(frame)->frameMs * scale); y < top; y++) {
+            if(y >= 0) column[y] = PACK_RGB(60, 60, 60);
+        }
+        for(j = 0; j < PROF_STAGES && top > 0; j++)
+        {
+            const float *c = profStageColors[j];
+            int bottom = top;
+            top -= (int)(profFrameAt(frame)->stageMs[j] * scale + 0.5f);
+            for(i = top < 0 ? 0 : top; i < bottom; i++) column[i] = PACK_RGB((int)(c[0]*255), (int)(c[1]*255), (int)(c[2]*255));
+        }
+    }
+}
+
+// Average and worst time of each stage over the graphed frames, beside the graph
+void profDrawLegend()
+{
+    char line[64];
+    int j, x = (renderW / 2 < PROF_GRAPH_FRAMES ? renderW / 2 : PROF_GRAPH_FRAMES) * screenW / renderW + 10;
+    float avg, worst;
+
+    profStageStats(-1, PROF_GRAPH_FRAMES, &avg, &worst);
+    sprintf(line, "FRAME %.2f MAX %.2f", avg, worst);
+    drawText(line, x, 18, 1.0f, 1.0f, 1.0f);
+    for(j = 0; j < PROF_STAGES; j++) {
+        profStageStats(j, PROF_GRAPH_FRAMES, &avg, &worst);
+        sprintf(line, "%s %.2f MAX %.2f", profStageNames[j], avg, worst);
+        drawText(line, x, 18 * (j + 2), profStageColors[j][0], profStageColors[j][1], profStageColors[j][2]);
+    }
+}
+#endif
+
+
+// WORKER POOL
+
+// Work over [begin, end) of a pass; worker picks per-thread scratch space
+typedef void (*RangeJob)(int worker, int begin, int end);
+
+int numThreads = 0; // Render threads including the main thread, 0: one per CPU
+
+pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t poolWake = PTHREAD_COND_INITIALIZER;
+pthread_cond_t poolDone = PTHREAD_COND_INITIALIZER;
+RangeJob poolJob; // Current job and its range size
+int poolCount;
+int poolGeneration = 0; // Bumped for every job so sleeping workers notice it
+int poolPending = 0; // Workers that have not finished the current job
+
+int cpuCount()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+// Each worker always gets the same contiguous strip, so output does not depend on timing
+void runStrip(int worker)
+{
+    int begin = (int)((long long)poolCount * worker / numThreads);
+    int end = (int)((long long)poolCount * (worker + 1) / numThreads);
+    if(begin < end) poolJob(worker, begin, end);
+}
+
+void *workerMain(void *arg)
+{
+    int worker = (int)(intptr_t)arg;
+    int seen = 0;
+
+    pthread_mutex_lock(&poolMutex);
+    for(;;)
+    {
+        while(poolGeneration == seen) pthread_cond_wait(&poolWake, &poolMutex);
+        seen = poolGeneration;
+        pthread_mutex_unlock(&poolMutex);
+
+        runStrip(worker);
+
+        pthread_mutex_lock(&poolMutex);
+        if(--poolPending == 0) pthread_cond_signal(&poolDone);
+    }
+    return NULL;
+}
+
+// Starts the persistent workers; the calling thread acts as worker 0
+void startWorkers()
+{
+    int w;
+    pthread_t thread;
+
+    if(numThreads <= 0) numThreads = cpuCount();
+    if(numThreads > MAX_THREADS) numThreads = MAX_THREADS;
+
+    for(w = 1; w < numThreads; w++)
+    {
+        if(pthread_create(&thread, NULL, workerMain, (void *)(intptr_t)w) != 0) {
+            numThreads = w; // Run with what we got
+            break;
+        }
+        pthread_detach(thread);
+    }
+}
+
+// Runs job over [0, count) split into one strip per thread and returns once
+// every strip is done, so it doubles as the barrier between passes
+void runParallel(RangeJob job, int count)
+{
+    if(numThreads <= 1) {
+        job(0, 0, count);
+        return;
+    }
+
+    pthread_mutex_lock(&poolMutex);
+    poolJob = job;
+    poolCount = count;
+    poolPending = numThreads - 1;
+    poolGeneration++;
+    pthread_cond_broadcast(&poolWake);
+    pthread_mutex_unlock(&poolMutex);
+
+    runStrip(0);
+
+    pthread_mutex_lock(&poolMutex);
+    while(poolPending > 0) pthread_cond_wait(&poolDone, &poolMutex);
+    pthread_mutex_unlock(&poolMutex);
+}
+
+// PALETTE
+
+// Indexed colour mode quantises every surface to one 256-colour palette at load time
+// and precomputes colormap[level][index], the entry closest to that colour at that
+// light. Side shade and distance fog then cost one table read per texel, and a pixel
+// stays one byte until expandFrame() turns the frame into RGBA for upload.
+#define LIGHT_LEVELS 32
+#define FOG_RANGE 1024.0f // Distance (16 cells) at which the light is down to FOG_MIN
+#define FOG_MIN 0.2f
+
+uint8_t colormap[LIGHT_LEVELS][256];
+
+// Colormap row for a surface dist away; shade is its side shade (shadeLevels)
+int lightLevel(float dist, float shade)
+{
+    float light = 1.0f - dist * (1.0f - FOG_MIN) / FOG_RANGE;
+    if(light < FOG_MIN) light = FOG_MIN;
+    return (int)(light * shade * (LIGHT_LEVELS - 1) + 0.5f);
+}
+
+uint32_t scaleColor(uint32_t c, float light)
+{
+    return PACK_RGB((int)((c & 0xFF) * light), (int)(((c >> 8) & 0xFF) * light), (int)(((c >> 16) & 0xFF) * light));
+}
+
+// 5-5-5 colour and the number of texels that use it
+typedef struct {
+    uint16_t color;
+    uint32_t count;
+} ColorBin;
+
+int binShift; // Channel compareBins() sorts on: 10 red, 5 green, 0 blue
+
+int compareBins(const void *a, const void *b)
+{
+    return ((((const ColorBin *)a)->color >> binShift) & 0x1F) - ((((const ColorBin *)b)->color >> binShift) & 0x1F);
+}
+
+// Counts the opaque texels at a spread of light levels, so the palette also has
+// the darker shades fog and side shade will ask for
+void countTexels(uint32_t *histogram, const uint32_t *texels, int count)
+{
+    static const float lights[] = { 1.0f, 0.7f, 0.45f, 0.25f, 0.14f };
+    int i, l;
+
+    for(i = 0; i < count; i++) {
+        if(!(texels[i] >> 24)) continue;
+        for(l = 0; l < (int)(sizeof(lights) / sizeof(lights[0])); l++) histogram[color555(scaleColor(texels[i], lights[l]))]++;
+    }
+}
+
+// Median cut: repeatedly splits the box with the most texels times its longest side
+// at the weighted median of that side, up to 256 boxes. Each box becomes the mean of
+// its colours; returns how many entries of palette are used.
+int medianCut(ColorBin *bins, int binCount)
+{
+    int begin[256], end[256];
+    int boxes = 1, b, i, c;
+
+    begin[0] = 0;
+    end[0] = binCount;
+    while(boxes < 256)
+    {
+        int best = -1, bestShift = 0, split;
+        double bestScore = 0;
+        uint64_t total = 0, half = 0;
+
+        for(b = 0; b < boxes; b++)
+        {
+            uint64_t count = 0;
+            int shift;
+            for(i = begin[b]; i < end[b]; i++) count += bins[i].count;
+            for(shift = 0; shift <= 10; shift += 5)
+            {
+                int lo = 31, hi = 0;
+                for(i = begin[b]; i < end[b]; i++) {
+                    c = (bins[i].color >> shift) & 0x1F;
+                    if(c < lo) lo = c;
+                    if(c > hi) hi = c;
+                }
+                if(hi > lo && (double)count * (hi - lo) > bestScore) {
+                    bestScore = (double)count * (hi - lo);
+                    best = b;
+                    bestShift = shift;
+                }
+            }
+        }
+        if(best < 0) break; // Every box is down to one colour
+
+        binShift = bestShift;
+        qsort(bins + begin[best], end[best] - begin[best], sizeof(ColorBin), compareBins);
+        for(i = begin[best]; i < end[best]; i++) total += bins[i].count;
+        for(split = begin[best]; split < end[best] - 1 && (half += bins[split].count) * 2 < total; split++);
+        split++;
+        if(split >= end[best]) split = end[best] - 1;
+
+        begin[boxes] = split;
+        end[boxes] = end[best];
+        end[best] = split;
+        boxes++;
+    }
+
+    for(b = 0; b < boxes; b++)
+    {
+        uint64_t sum[3] = {0, 0, 0}, count = 0;
+        for(i = begin[b]; i < end[b]; i++) {
+            for(c = 0; c < 3; c++) {
+                int v = (bins[i].color >> (10 - c * 5)) & 0x1F;
+                sum[c] += (uint64_t)((v << 3) | (v >> 2)) * bins[i].count;
+            }
+            count += bins[i].count;
+        }
+        palette[b] = count ? PACK_RGB(sum[0] / count, sum[1] / count, sum[2] / count) : PACK_RGB(0, 0, 0);
+    }
+    return boxes;
+}
+
+void indexMips(const MipTexture *tex, IndexedMips *dst)
+{
+    int level, i;
+
+    for(level = 0; level < tex->levels; level++)
+    {
+        const Texture *src = &tex->mips[level];
+        int count = src->size * src->size;
+        dst->mips[level] = (uint8_t *)allocOrDie(NULL, (size_t)count);
+        for(i = 0; i < count; i++) dst->mips[level][i] = paletteIndex(src->texels[i]);
+    }
+}
+
+void indexSprite(SpriteImage *img)
+{
+    int i, count = img->width * img->height;
+
+    img->indices = (uint8_t *)allocOrDie(img->indices, (size_t)count);
+    for(i = 0; i < count; i++) img->indices[i] = paletteIndex(img->texels[i]);
+}
+
+// Builds the palette, its lookup table and colormap, then the indexed copy of every
+// surface. Called once the textures and sprites are loaded.
+void initPalette()
+{
+    uint32_t *histogram = (uint32_t *)allocOrDie(NULL, (1 << 15) * sizeof(uint32_t));
+    ColorBin *bins;
+    int binCount = 0, size, c, i, l;
+
+    memset(histogram, 0, (1 << 15) * sizeof(uint32_t));
+    for(i = 1; i < MAX_MATERIALS; i++) {
+        const Texture *tex = &materials[i]->flat.mips[0];
+        if(hasMaterial(i)) countTexels(histogram, tex->texels, tex->size * tex->size);
+    }
+    countTexels(histogram, keyImage.texels, keyImage.width * keyImage.height);
+    countTexels(histogram, minotaurImage.texels, minotaurImage.width * minotaurImage.height);
+    histogram[color555(PACK_RGB(51, 51, 51))]++; // Clear colour
+
+    bins = (ColorBin *)allocOrDie(NULL, (1 << 15) * sizeof(ColorBin));
+    for(c = 0; c < 1 << 15; c++) {
+        if(!histogram[c]) continue;
+        bins[binCount].color = (uint16_t)c;
+        bins[binCount].count = histogram[c];
+        binCount++;
+    }
+    size = medianCut(bins, binCount);
+    free(bins);
+    free(histogram);
+
+    // Nearest entry for every 5-5-5 colour
+    for(c = 0; c < 1 << 15; c++)
+    {
+        int r = ((c >> 7) & 0xF8) | ((c >> 12) & 7), g = ((c >> 2) & 0xF8) | ((c >> 7) & 7), b = ((c << 3) & 0xF8) | ((c >> 2) & 7);
+        int bestDist = 1 << 30;
+        for(i = 0; i < size; i++) {
+            int dr = r - (int)(palette[i] & 0xFF), dg = g - (int)((palette[i] >> 8) & 0xFF), db = b - (int)((palette[i] >> 16) & 0xFF);
+            int dist = dr * dr + dg * dg + db * db;
+            if(dist < bestDist) {
+                bestDist = dist;
+                paletteLookup[c] = (uint8_t)i;
+            }
+        }
+    }
+
+    for(l = 0; l < LIGHT_LEVELS; l++) {
+        for(i = 0; i < 256; i++) colormap[l][i] = paletteIndex(scaleColor(palette[i], (float)l / (LIGHT_LEVELS - 1)));
+    }
+
+    for(i = 1; i < MAX_MATERIALS; i++) {
+        if(!hasMaterial(i)) continue;
+        indexMips(&materials[i]->flat, &materials[i]->flatIndices);
+        indexMips(&materials[i]->wall[0], &materials[i]->wallIndices);
+    }
+    indexSprite(&keyImage);
+    indexSprite(&minotaurImage);
+}
+
+// Fills frameBuffer columns [begin, end) from frameIndex
+void expandRange(int worker, int begin, int end)
+{
+    const uint8_t *src = indexColumn(begin);
+    uint32_t *dst = frameColumn(begin);
+    int i, count = (end - begin) * renderH;
+
+    (void)worker;
+    for(i = 0; i < count; i++) dst[i] = palette[src[i]];
+}
+
+void expandFrame()
+{
+    runParallel(expandRange, renderW);
+}
+
+// RAYCASTING & RENDERING
+
+// Per-ray results shared by the ceiling, wall and floor passes
+typedef struct {
+    float disT; // Fish-eye corrected wall distance
+    float lineH; // Wall height on screen
+    float lineOff; // Wall top on screen, negative when the wall is taller than the screen
+    int shade; // Index into shadeLevels
+    float texU; // Position across the wall texture, 0..1
+    int material; // Map value that was hit, an index into materials (an int keeps the struct small)
+} RayColumn;
+
+RayColumn *rayColumns = NULL;
+
+// Per-column camera ray
+typedef struct {
+    float dirX, dirY; // Unit ray direction
+    float fisheye; // Cosine of the angle to the view direction
+    float stepX, stepY; // dir / fisheye: world offset per unit of perpendicular distance
+} CameraRay;
+
+// Everything the passes need from the camera, rebuilt only when it changes
+typedef struct {
+    int valid;
+    float pa, fov; // Pose and FOV the table was built for
+    float fwdX, fwdY; // View direction
+    float rightX, rightY; // Screen right, scaled to tan(fov/2)
+    float tanHalfFov;
+    CameraRay *rays; // One per ray column
+    float *rowDist; // Perpendicular floor/ceiling distance seen by each framebuffer row
+} CameraTable;
+
+CameraTable camera;
+uint32_t *rowSpans = NULL; // Per-thread scratch spans for the floor/ceiling row kernel
+int rowSpanStride = 0; // Texels per thread in rowSpans
+int floorRowStart = 0; // First floor row for floorRowJob()
+
+// Planar projection: column rays are spread evenly across the screen plane,
+// so world positions along a screen row are linear in x
+void updateCameraTable()
+{
+    int r, y;
+
+    if(camera.valid && camera.pa == viewA && camera.fov == fov) return;
+
+    camera.pa = viewA;
+    camera.fov = fov;
+    camera.tanHalfFov = tanf(fov / 2.0f);
+    camera.fwdX = cosf(viewA);
+    camera.fwdY = sinf(viewA);
+    camera.rightX = -camera.fwdY * camera.tanHalfFov;
+    camera.rightY = camera.fwdX * camera.tanHalfFov;
+
+    for(r = 0; r < numRays; r++)
+    {
+        CameraRay *ray = &camera.rays[r];
+        float cameraX = (2.0f * r * columnW + columnW) / renderW - 1.0f; // Column centre
+        float len;
+
+        ray->stepX = camera.fwdX + camera.rightX * cameraX;
+        ray->stepY = camera.fwdY + camera.rightY * cameraX;
+        len = sqrtf(ray->stepX * ray->stepX + ray->stepY * ray->stepY);
+        ray->fisheye = 1.0f / len;
+        ray->dirX = ray->stepX * ray->fisheye;
+        ray->dirY = ray->stepY * ray->fisheye;
+    }
+
+    // The row table only depends on the resolution
+    if(!camera.valid)
+    {
+        for(y = 0; y < renderH; y++)
+        {
+            float dy = fabsf(y - renderH / 2.0f);
+            camera.rowDist[y] = dy < 1e-6f ? 1e30f : (mapS * renderH / 2.0f) / dy;
+        }
+    }
+    camera.valid = 1;
+}
+
+// RESOLUTION
+
+// Derives the framebuffer size and ray count from the window size and renderScale
+void applyRenderScale()
+{
+    renderW = (int)(screenW * renderScale + 0.5f);
+    renderH = (int)(screenH * renderScale + 0.5f);
+    if(renderW < 1) renderW = 1;
+    if(renderH < 2) renderH = 2;
+    numRays = (renderW + columnW - 1) / columnW;
+    camera.valid = 0;
+}
+
+// Sizes every per-column and per-row buffer for a full-scale render of a w x h window
+void setScreenSize(int w, int h)
+{
+    screenW = w > 16 ? w : 16;
+    screenH = h > 16 ? h : 16;
+    if(columnW < 1) columnW = 1;
+
+    frameBuffer = (uint32_t *)allocOrDie(frameBuffer, (size_t)screenW * screenH * sizeof(uint32_t));
+    if(indexedColor) frameIndex = (uint8_t *)allocOrDie(frameIndex, (size_t)screenW * screenH);
+    depthBuffer = (float *)allocOrDie(depthBuffer, screenW * sizeof(float));
+    rayColumns = (RayColumn *)allocOrDie(rayColumns, screenW * sizeof(RayColumn));
+    camera.rays = (CameraRay *)allocOrDie(camera.rays, screenW * sizeof(CameraRay));
+    camera.rowDist = (float *)allocOrDie(camera.rowDist, screenH * sizeof(float));
+    rowSpanStride = screenW;
+    rowSpans = (uint32_t *)allocOrDie(rowSpans, (size_t)screenW * (numThreads > 0 ? numThreads : 1) * sizeof(uint32_t));
+    applyRenderScale();
+}
+
+#ifdef PROFILE
+#define PROFILE_USAGE " [-profile file.csv|file.json]"
+#else
+#define PROFILE_USAGE ""
+#endif
+#define RENDER_USAGE "[-w width] [-h height] [-fov degrees] [-cols pixels] [-budget ms] [-threads n] [-fps n] [-stats] [-pack file] [-map WxH] [-seed n] [-maze backtracker|wilson|eller] [-endless] [-minotaurs n] [-indexed]" PROFILE_USAGE
+
+// Applies a render or asset option from the command line; returns the arguments used (0 if unknown)
+int parseRenderOption(int argc, char **argv, int i)
+{
+    if(!strcmp(argv[i], "-endless")) {
+        endless = 1;
+        return 1;
+    }
+    if(!strcmp(argv[i], "-stats")) {
+        showStats = 1;
+        return 1;
+    }
+    if(!strcmp(argv[i], "-indexed")) {
+        indexedColor = 1;
+        return 1;
+    }
+    if(i + 1 >= argc) return 0;
+    if(!strcmp(argv[i], "-w")) screenW = atoi(argv[i+1]);
+    else if(!strcmp(argv[i], "-h")) screenH = atoi(argv[i+1]);
+    else if(!strcmp(argv[i], "-fov")) {
+        float degrees = (float)atof(argv[i+1]);
+        if(degrees <= 0 || degrees >= 180) return 0; // The camera table needs tan(fov / 2)
+        fov = degrees * DR;
+    }
+    else if(!strcmp(argv[i], "-cols")) columnW = atoi(argv[i+1]);
+    else if(!strcmp(argv[i], "-budget")) frameBudgetMs = (float)atof(argv[i+1]);
+    else if(!strcmp(argv[i], "-threads")) numThreads = atoi(argv[i+1]);
+    else if(!strcmp(argv[i], "-fps")) fpsCap = atoi(argv[i+1]);
+    else if(!strcmp(argv[i], "-pack")) packPath = argv[i+1];
+#ifdef PROFILE
+    else if(!strcmp(argv[i], "-profile")) profPath = argv[i+1];
+#endif
+    else if(!strcmp(argv[i], "-map")) {
+        int w, h;
+        if(sscanf(argv[i+1], "%dx%d", &w, &h) != 2 || w < 5 || h < 5 || w > MAX_MAP_SIZE || h > MAX_MAP_SIZE) return 0;
+        mapX = w;
+        mapY = h;
+    }
+    else if(!strcmp(argv[i], "-seed")) gameSeed = strtoul(argv[i+1], NULL, 10);
+    else if(!strcmp(argv[i], "-minotaurs")) {
+        minotaurOption = atoi(argv[i+1]);
+        if(minotaurOption < 0) return 0;
+    }
+    else if(!strcmp(argv[i], "-maze")) {
+        for(mazeAlgorithm = MAZE_ALGORITHMS - 1; mazeAlgorithm > 0; mazeAlgorithm--) {
+            if(!strcmp(argv[i+1], mazeAlgorithms[mazeAlgorithm].name)) break;
+        }
+        if(strcmp(argv[i+1], mazeAlgorithms[mazeAlgorithm].name)) return 0;
+    }
+    else return 0;
+    return 2;
+}
+
+// DYNAMIC RESOLUTION
+
+double smoothedFrameMs = 0; // Running average of the render time
+int framesSinceScale = 0;
+
+// Called once per frame with the time it took to render. Steps renderScale down
+// while over budget and back up once there is clear headroom.
+void updateRenderScale(double frameMs)
+{
+    float scale = renderScale;
+
+    if(frameBudgetMs <= 0) return;
+    smoothedFrameMs = smoothedFrameMs > 0 ? smoothedFrameMs * 0.9 + frameMs * 0.1 : frameMs;
+    if(++framesSinceScale < 10) return; // Let the average settle after each change
+
+    if(smoothedFrameMs > frameBudgetMs) scale *= 0.85f;
+    else if(smoothedFrameMs < frameBudgetMs * 0.6f) scale *= 1.1f;
+    if(scale < minRenderScale) scale = minRenderScale;
+    if(scale > 1.0f) scale = 1.0f;
+
+    if(scale != renderScale)
+    {
+        renderScale = scale;
+        applyRenderScale();
+        framesSinceScale = 0;
+        smoothedFrameMs = 0;
+    }
+}
+
+// Result of one ray traversal
+typedef struct {
+    float dist; // Distance along the ray to the hit
+    float hitX, hitY; // World-space hit point
+    int side; // 0: crossed a vertical grid line, 1: a horizontal one
+    int cell; // Map value that was hit, 0 if the ray left the map
+    float texU; // Position across the wall texture at the hit point, 0..1
+} RayHit;
+
+// Amanatides-Woo grid traversal: visits every cell the ray crosses exactly once,
+// until it reaches a wall or door or leaves the map. Open cells are appended to visited.
+void castRay(float ox, float oy, float dirX, float dirY, RayHit *hit, CellList *visited)
+{
+    int mx = (int)ox >> 6, my = (int)oy >> 6;
+    int stepX = dirX < 0 ? -1 : 1;
+    int stepY = dirY < 0 ? -1 : 1;
+    float tDeltaX = fabsf(dirX) > 1e-9f ? fabsf(mapS / dirX) : 1e30f;
+    float tDeltaY = fabsf(dirY) > 1e-9f ? fabsf(mapS / dirY) : 1e30f;
+    float tMaxX, tMaxY, t = 0;
+    int side = 0, cell = 0, index;
+
+    // Distance to the first vertical and horizontal grid lines
+    if(fabsf(dirX) <= 1e-9f) tMaxX = 1e30f;
+    else if(dirX < 0) tMaxX = (ox - mx * mapS) / -dirX;
+    else tMaxX = ((mx + 1) * mapS - ox) / dirX;
+    if(fabsf(dirY) <= 1e-9f) tMaxY = 1e30f;
+    else if(dirY < 0) tMaxY = (oy - my * mapS) / -dirY;
+    else tMaxY = ((my + 1) * mapS - oy) / dirY;
+
+    if((index = cellIndex(mx, my)) >= 0) addCell(visited, index);
+    for(;;)
+    {
+        if(tMaxX < tMaxY) { mx += stepX; t = tMaxX; tMaxX += tDeltaX; side = 0; }
+        else { my += stepY; t = tMaxY; tMaxY += tDeltaY; side = 1; }
+
+        index = cellIndex(mx, my);
+        if(index < 0) { cell = endless ? 1 : 0; break; } // Off the map: open; unloaded chunk: wall
+        if(isSolidCell(index)) { cell = map[index]; break; }
+        addCell(visited, index);
+    }
+
+    hit->dist = t;
+    hit->hitX = ox + dirX * t;
+    hit->hitY = oy + dirY * t;
+    hit->side = side;
+    hit->cell = cell;
+    hit->texU = (side == 0 ? hit->hitY : hit->hitX) / TEX_REPEAT;
+    hit->texU -= floorf(hit->texU);
+}
+
+void castRayRange(int worker, int begin, int end)
+{
+    int r, i;
+    float disT, lineH;
+    RayHit hit;
+
+    for(r=begin;r<end;r++) 
+    {
+        RayColumn *rc = &rayColumns[r];
+        CameraRay *ray = &camera.rays[r];
+
+        castRay(viewX, viewY, ray->dirX, ray->dirY, &hit, &rayCells[worker]);
+
+        // Vertical grid lines are lit, horizontal ones shaded
+        rc->material = hit.cell;
+        rc->shade = hit.side;
+        rc->texU = hit.texU;
+
+        // Fish-eye correction
+        disT = hit.dist * ray->fisheye;
+        if(disT < 1e-3f) disT = 1e-3f;
+
+        // Store distance in the depth buffer
+        for(i = r*columnW; i < (r+1)*columnW && i < renderW; i++) {
+            depthBuffer[i] = disT;
+        }
+
+        // Calculate wall height and vertical offset (not clamped: the wall pass clips)
+        lineH = (mapS * renderH) / disT;
+
+        rc->disT = disT;
+        rc->lineH = lineH;
+        rc->lineOff = renderH/2.0f - lineH/2.0f;
+    }
+}
+
+void castRays()
+{
+    updateCameraTable();
+    runParallel(castRayRange, numRays);
+    collectVisibleCells();
+}
+
+// Fills one contiguous span of texels, stepping a 16.16 texture coordinate per pixel.
+// tex is a square power-of-two texture of (1 << shift) texels per side.
+#if defined(__AVX2__)
+void fillTexSpan(uint32_t *span, int count, const uint32_t *tex, int shift,
+                 uint32_t fx, uint32_t fy, uint32_t stepX, uint32_t stepY)
+{
+    int i = 0;
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i vx = _mm256_add_epi32(_mm256_set1_epi32((int)fx), _mm256_mullo_epi32(lane, _mm256_set1_epi32((int)stepX)));
+    __m256i vy = _mm256_add_epi32(_mm256_set1_epi32((int)fy), _mm256_mullo_epi32(lane, _mm256_set1_epi32((int)stepY)));
+    __m256i vstepX = _mm256_set1_epi32((int)(stepX * 8));
+    __m256i vstepY = _mm256_set1_epi32((int)(stepY * 8));
+    __m256i mask = _mm256_set1_epi32((1 << shift) - 1);
+    __m128i rowShift = _mm_cvtsi32_si128(shift);
+
+    for(; i + 8 <= count; i += 8)
+    {
+        __m256i tx = _mm256_and_si256(_mm256_srli_epi32(vx, 16), mask);
+        __m256i ty = _mm256_and_si256(_mm256_srli_epi32(vy, 16), mask);
+        __m256i idx = _mm256_or_si256(_mm256_sll_epi32(ty, rowShift), tx);
+        _mm256_storeu_si256((__m256i *)(span + i), _mm256_i32gather_epi32((const int *)tex, idx, 4));
+        vx = _mm256_add_epi32(vx, vstepX);
+        vy = _mm256_add_epi32(vy, vstepY);
+    }
+    fx += stepX * i; fy += stepY * i;
+    for(; i < count; i++) {
+        span[i] = tex[((((fy >> 16) & ((1u << shift) - 1))) << shift) | ((fx >> 16) & ((1u << shift) - 1))];
+        fx += stepX; fy += stepY;
+    }
+}
+#elif defined(__SSE2__)
+void fillTexSpan(uint32_t *span, int count, const uint32_t *tex, int shift,
+                 uint32_t fx, uint32_t fy, uint32_t stepX, uint32_t stepY)
+{
+    int i = 0;
+    __m128i vx = _mm_setr_epi32((int)fx, (int)(fx + stepX), (int)(fx + stepX*2), (int)(fx + stepX*3));
+    __m128i vy = _mm_setr_epi32((int)fy, (int)(fy + stepY), (int)(fy + stepY*2), (int)(fy + stepY*3));
+    __m128i vstepX = _mm_set1_epi32((int)(stepX * 4));
+    __m128i vstepY = _mm_set1_epi32((int)(stepY * 4));
+    __m128i mask = _mm_set1_epi32((1 << shift) - 1);
+    __m128i rowShift = _mm_cvtsi32_si128(shift);
+    uint32_t idx[4];
+
+    // SSE2 has no gather: indices are computed 4 wide, texels fetched and stored as a group
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128i tx = _mm_and_si128(_mm_srli_epi32(vx, 16), mask);
+        __m128i ty = _mm_and_si128(_mm_srli_epi32(vy, 16), mask);
+        _mm_storeu_si128((__m128i *)idx, _mm_or_si128(_mm_sll_epi32(ty, rowShift), tx));
+        _mm_storeu_si128((__m128i *)(span + i), _mm_setr_epi32((int)tex[idx[0]], (int)tex[idx[1]], (int)tex[idx[2]], (int)tex[idx[3]]));
+        vx = _mm_add_epi32(vx, vstepX);
+        vy = _mm_add_epi32(vy, vstepY);
+    }
+    fx += stepX * i; fy += stepY * i;
+    for(; i < count; i++) {
+        span[i] = tex[((((fy >> 16) & ((1u << shift) - 1))) << shift) | ((fx >> 16) & ((1u << shift) - 1))];
+        fx += stepX; fy += stepY;
+    }
+}
+#else
+void fillTexSpan(uint32_t *span, int count, const uint32_t *tex, int shift,
+                 uint32_t fx, uint32_t fy, uint32_t stepX, uint32_t stepY)
+{
+    uint32_t mask = (1u << shift) - 1;
+    int i;
+    for(i = 0; i < count; i++) {
+        span[i] = tex[(((fy >> 16) & mask) << shift) | ((fx >> 16) & mask)];
+        fx += stepX; fy += stepY;
+    }
+}
+#endif
+
+// Same walk over a texture of palette indices, lighting each texel through a colormap row
+void fillIndexSpan(uint8_t *span, int count, const uint8_t *tex, int shift, const uint8_t *light,
+                   uint32_t fx, uint32_t fy, uint32_t stepX, uint32_t stepY)
+{
+    uint32_t mask = (1u << shift) - 1;
+    int i;
+    for(i = 0; i < count; i++) {
+        span[i] = light[tex[(((fy >> 16) & mask) << shift) | ((fx >> 16) & mask)]];
+        fx += stepX; fy += stepY;
+    }
+}
+
+// World coordinate to 16.16 texels. Textures repeat every 32 world units and the
+// 2^32 wrap is a multiple of that, so only the low bits need to survive.
+uint32_t toTexFixed(float w)
+{
+    return (uint32_t)(int64_t)(w * 65536.0f);
+}
+
+int flatVersion = -1; // mapVersion that ceilingUniform and floorUniform were found for
+const Material *ceilingUniform, *floorUniform; // Shared by every cell of the layer, NULL if not
+
+// The material of every cell of a layer if it is the same throughout and the same as
+// off the map, else NULL. A uniform layer is drawn without walking its cells.
+const Material *uniformMaterial(const uint8_t *layer, int fallback)
+{
+    int i, cells = mapX * mapY;
+    if(materials[layer[0]] != materials[fallback]) return NULL;
+    for(i = 1; i < cells; i++) {
+        if(layer[i] != layer[0]) return NULL;
+    }
+    return materials[fallback];
+}
+
+void updateFlatMaterials()
+{
+    if(flatVersion == mapVersion) return;
+    ceilingUniform = uniformMaterial(mapCeiling, MATERIAL_CEILING);
+    floorUniform = uniformMaterial(mapFloor, MATERIAL_FLOOR);
+    flatVersion = mapVersion;
+}
+
+// Floor or ceiling material of cell (mx, my); cells off the map or in a chunk not
+// loaded yet have the default one
+const Material *flatMaterial(const uint8_t *layer, int mx, int my, int fallback)
+{
+    int index = cellIndex(mx, my);
+    return materials[index < 0 ? fallback : layer[index]];
+}
+
+// Fills columns [start, end) of a row span from one material. The 16.16 coordinates
+// advance from column 0, so consecutive spans continue exactly where the last stopped.
+void fillFlatSpan(uint32_t *rowSpan, int start, int end, const Material *mat, float rowDist,
+                  const uint8_t *light, float wx, float wy, float dx, float dy)
+{
+    // Level-0 texels between neighbouring columns
+    float spacing = camera.tanHalfFov * 2.0f * columnW / renderW * mat->flat.mips[0].size / TEX_REPEAT;
+    int level = mipLevel(&mat->flat, rowDist * spacing);
+    const Texture *tex = &mat->flat.mips[level];
+    float texScale = tex->size / TEX_REPEAT; // World units to texels
+    uint32_t stepX = toTexFixed(dx * texScale), stepY = toTexFixed(dy * texScale);
+    uint32_t fx = toTexFixed(wx * texScale) + stepX * start, fy = toTexFixed(wy * texScale) + stepY * start;
+
+    if(indexedColor) {
+        fillIndexSpan((uint8_t *)rowSpan + start, end - start, mat->flatIndices.mips[level], tex->shift, light,
+                      fx, fy, stepX, stepY);
+    }
+    else fillTexSpan(rowSpan + start, end - start, tex->texels, tex->shift, fx, fy, stepX, stepY);
+}
+
+// Fills a whole row span one run of same-material cells (from layer) at a time. A grid
+// traversal along the row, measured in columns: t is where the next vertical or
+// horizontal cell edge is crossed.
+void fillFlatRow(uint32_t *rowSpan, const uint8_t *layer, int fallback, float rowDist, const uint8_t *light,
+                 float wx, float wy, float dx, float dy)
+{
+    int mx = (int)floorf(wx / mapS), my = (int)floorf(wy / mapS);
+    int stepX = dx < 0 ? -1 : 1, stepY = dy < 0 ? -1 : 1;
+    float tDeltaX = fabsf(dx) > 1e-9f ? mapS / fabsf(dx) : 1e30f;
+    float tDeltaY = fabsf(dy) > 1e-9f ? mapS / fabsf(dy) : 1e30f;
+    float tMaxX = fabsf(dx) > 1e-9f ? ((dx < 0 ? mx : mx + 1) * mapS - wx) / dx : 1e30f;
+    float tMaxY = fabsf(dy) > 1e-9f ? ((dy < 0 ? my : my + 1) * mapS - wy) / dy : 1e30f;
+    const Material *mat = flatMaterial(layer, mx, my, fallback), *cellMat;
+    int start = 0, next;
+
+    for(;;)
+    {
+        float t = tMaxX < tMaxY ? tMaxX : tMaxY;
+        if(t > numRays - 1) break;
+        if(tMaxX < tMaxY) { mx += stepX; tMaxX += tDeltaX; }
+        else { my += stepY; tMaxY += tDeltaY; }
+
+        cellMat = flatMaterial(layer, mx, my, fallback);
+        if(cellMat == mat) continue;
+        next = (int)ceilf(t);
+        fillFlatSpan(rowSpan, start, next, mat, rowDist, light, wx, wy, dx, dy);
+        start = next;
+        mat = cellMat;
+    }
+    fillFlatSpan(rowSpan, start, numRays, mat, rowDist, light, wx, wy, dx, dy);
+}
+
+// Walks floor or ceiling rows [yStart, yEnd) once each. Every row is filled from the
+// leftmost to the rightmost column, in one span when the layer is uniform; each column
+// keeps only the rows it can see. In indexed colour the span is bytes, lit for the
+// row's distance.
+void drawFloorRows(uint32_t *rowSpan, int yStart, int yEnd, const uint8_t *layer, int fallback,
+                   const Material *uniform, int ceiling)
+{
+    int r, y;
+
+    for(y = yStart; y < yEnd; y++)
+    {
+        float rowDist = camera.rowDist[y];
+        const uint8_t *light = indexedColor ? colormap[lightLevel(rowDist, 1.0f)] : NULL;
+        float wx, wy, dx, dy;
+
+        if(rowDist >= 1e30f) continue;
+
+        // World position under the first column and the step to the next one
+        wx = viewX + camera.rays[0].stepX * rowDist;
+        wy = viewY + camera.rays[0].stepY * rowDist;
+        dx = camera.rightX * rowDist * 2.0f * columnW / renderW;
+        dy = camera.rightY * rowDist * 2.0f * columnW / renderW;
+
+        if(uniform) fillFlatSpan(rowSpan, 0, numRays, uniform, rowDist, light, wx, wy, dx, dy);
+        else fillFlatRow(rowSpan, layer, fallback, rowDist, light, wx, wy, dx, dy);
+
+        if(indexedColor)
+        {
+            const uint8_t *span = (const uint8_t *)rowSpan;
+            for(r = 0; r < numRays; r++)
+            {
+                RayColumn *rc = &rayColumns[r];
+                int visible = ceiling ? y < (int)rc->lineOff : y >= (int)(rc->lineH + rc->lineOff);
+                if(visible) indexColumn(r*columnW)[y] = span[r];
+            }
+            continue;
+        }
+
+        for(r = 0; r < numRays; r++)
+        {
+            RayColumn *rc = &rayColumns[r];
+            int visible = ceiling ? y < (int)rc->lineOff : y >= (int)(rc->lineH + rc->lineOff);
+            if(visible) frameColumn(r*columnW)[y] = rowSpan[r];
+        }
+    }
+}
+
+void ceilingRowJob(int worker, int begin, int end)
+{
+    drawFloorRows(rowSpans + worker * rowSpanStride, begin, end, mapCeiling, MATERIAL_CEILING, ceilingUniform, 1);
+}
+
+void floorRowJob(int worker, int begin, int end)
+{
+    drawFloorRows(rowSpans + worker * rowSpanStride, floorRowStart + begin, floorRowStart + end, mapFloor, MATERIAL_FLOOR, floorUniform, 0);
+}
+
+// Draw Ceiling (mapCeiling[] materials)
+void drawCeiling()
+{
+    int r, yEnd = 0;
+
+    // Lowest row any column still sees ceiling on
+    for(r = 0; r < numRays; r++) {
+        if((int)rayColumns[r].lineOff > yEnd) yEnd = (int)rayColumns[r].lineOff;
+    }
+    updateFlatMaterials();
+    runParallel(ceilingRowJob, yEnd);
+}
+
+// Draw Wall (map[] materials)
+void wallRange(int worker, int begin, int end)
+{
+    int r, y;
+
+    (void)worker;
+    for(r = begin; r < end; r++)
+    {
+        RayColumn *rc = &rayColumns[r];
+        uint32_t *column = frameColumn(r*columnW);
+        // Texture and shade are picked once per column; the loop is branch-free
+        const Material *mat = materials[rc->material];
+        const MipTexture *mips = &mat->wall[rc->shade];
+        int level = mipLevel(mips, mips->mips[0].size / rc->lineH);
+        const Texture *wall = &mips->mips[level];
+        int mask = wall->size - 1;
+        int texColumn = ((int)(rc->texU * wall->size) & mask) << wall->shift;
+        const uint32_t *tex = wall->texels + texColumn;
+        uint32_t texStep = (uint32_t)(wall->size * 65536.0f / rc->lineH); // 16.16 texels per pixel
+        uint32_t texPos;
+        int yStart = (int)rc->lineOff;
+        int yEnd = (int)(rc->lineOff + rc->lineH);
+
+        // Columns taller than the screen start part-way into the texture
+        if(yStart < 0) yStart = 0;
+        if(yEnd > renderH) yEnd = renderH;
+        texPos = (uint32_t)((yStart - rc->lineOff) * texStep);
+
+        if(indexedColor)
+        {
+            // Unshaded indices, lit by the colormap row for this column's distance and side
+            const uint8_t *light = colormap[lightLevel(rc->disT, shadeLevels[rc->shade])];
+            const uint8_t *indices = mat->wallIndices.mips[level] + texColumn;
+            uint8_t *pixels = indexColumn(r*columnW);
+            for(y = yStart; y < yEnd; y++)
+            {
+                pixels[y] = light[indices[(texPos >> 16) & mask]];
+                texPos += texStep;
+            }
+            continue;
+        }
+
+        for(y = yStart; y < yEnd; y++)
+        {
+            column[y] = tex[(texPos >> 16) & mask];
+            texPos += texStep;
+        }
+    }
+}
+
+void drawWalls()
+{
+    runParallel(wallRange, numRays);
+}
+
+// Draw Floor (mapFloor[] materials)
+void drawFloor()
+{
+    int r, yStart = renderH;
+
+    // Highest row any column already sees floor on
+    for(r = 0; r < numRays; r++) {
+        int floorStart = (int)(rayColumns[r].lineH + rayColumns[r].lineOff);
+        if(floorStart < yStart) yStart = floorStart;
+    }
+    floorRowStart = yStart;
+    updateFlatMaterials();
+    runParallel(floorRowJob, renderH - yStart);
+}
+
+// Widen each ray to its pixel columns (contiguous copies in column-major order)
+void widenRange(int worker, int begin, int end)
+{
+    int r, i;
+
+    (void)worker;
+    for(r = begin; r < end; r++)
+    {
+        uint32_t *column = frameColumn(r*columnW);
+        for(i = r*columnW + 1; i < (r+1)*columnW && i < renderW; i++) {
+            if(indexedColor) memcpy(indexColumn(i), indexColumn(r*columnW), renderH);
+            else memcpy(frameColumn(i), column, renderH * sizeof(uint32_t));
+        }
+    }
+}
+
+void widenColumns()
+{
+    runParallel(widenRange, numRays);
+}
+
+// Each pass is split across the worker pool; runParallel() returns only once
+// the pass is complete, so passes never overlap and sprites see a finished frame
+void drawRays3D()
+{
+    PROF_BEGIN(PROF_RAYCAST);
+    castRays();
+    PROF_END(PROF_RAYCAST);
+    PROF_BEGIN(PROF_CEILING);
+    drawCeiling();
+    PROF_END(PROF_CEILING);
+    PROF_BEGIN(PROF_WALLS);
+    drawWalls();
+    PROF_END(PROF_WALLS);
+    PROF_BEGIN(PROF_FLOOR);
+    drawFloor();
+    PROF_END(PROF_FLOOR);
+    PROF_BEGIN(PROF_WIDEN);
+    widenColumns();
+    PROF_END(PROF_WIDEN);
+}
+
+// SPRITE RENDERING
+
+void allocSpriteImage(SpriteImage *img, int width, int height)
+{
+    img->width = width;
+    img->height = height;
+    img->texels = (uint32_t *)allocOrDie(NULL, (size_t)width * height * sizeof(uint32_t));
+    img->top = (int *)allocOrDie(NULL, width * sizeof(int));
+    img->bottom = (int *)allocOrDie(NULL, width * sizeof(int));
+    img->indices = NULL;
+}
+
+// Records the opaque extent of each column once the texels are in place
+void findSpriteSpans(SpriteImage *img)
+{
+    int x, y;
+
+    for(x = 0; x < img->width; x++)
+    {
+        const uint32_t *column = img->texels + x * img->height;
+        img->top[x] = img->bottom[x] = 0;
+        for(y = 0; y < img->height; y++) {
+            if(column[y] >> 24) {
+                if(img->top[x] == img->bottom[x]) img->top[x] = y;
+                img->bottom[x] = y + 1;
+            }
+        }
+    }
+}
+
+// Transposes a pack image (row-major RGBA, alpha from its colour key) into a sprite
+void loadSpriteImage(SpriteImage *img, const PackEntry *e)
+{
+    const uint32_t *src = assetTexels(e);
+    int x, y;
+
+    allocSpriteImage(img, (int)e->width, (int)e->height);
+    for(x = 0; x < img->width; x++) {
+        for(y = 0; y < img->height; y++) img->texels[x * img->height + y] = src[y * img->width + x];
+    }
+    findSpriteSpans(img);
+}
+
+// Key shape used when the pack has no "key" image
+void rasterizeKeyShape(SpriteImage *img, int size)
+{
+    int x, y;
+
+    allocSpriteImage(img, size, size);
+    for(x = 0; x < size; x++)
+    {
+        for(y = 0; y < size; y++)
+        {
+            float nx = (x + 0.5f) / size;
+            float ny = (y + 0.5f) / size;
+            float headDist = sqrtf((nx - 0.5f)*(nx - 0.5f) + (ny - 0.25f)*(ny - 0.25f));
+            int solid = headDist < 0.15f && headDist >= 0.06f; // Head with its hole
+            solid |= nx > 0.43f && nx < 0.57f && ny > 0.35f && ny < 0.75f; // Shaft
+            solid |= nx > 0.43f && nx < 0.50f && ny > 0.70f && ny < 0.78f; // Teeth
+            solid |= nx > 0.43f && nx < 0.50f && ny > 0.82f && ny < 0.90f;
+            img->texels[x * size + y] = solid ? PACK_RGB(255, 214, 0) : 0;
+        }
+    }
+    findSpriteSpans(img);
+}
+
+// Horned figure used when the pack has no "minotaur" image
+void rasterizeMinotaurShape(SpriteImage *img, int size)
+{
+    int x, y;
+
+    allocSpriteImage(img, size, size);
+    for(x = 0; x < size; x++)
+    {
+        for(y = 0; y < size; y++)
+        {
+            float nx = (x + 0.5f) / size;
+            float ny = (y + 0.5f) / size;
+            float cx = fabsf(nx - 0.5f); // Distance from the centre line: the shape is symmetric
+            float headDist = sqrtf(cx*cx + (ny - 0.3f)*(ny - 0.3f));
+            uint32_t c = 0;
+            if(cx > 0.08f && cx < 0.22f && ny > 0.1f + (0.22f - cx) * 0.8f && ny < 0.26f) c = PACK_RGB(230, 220, 190); // Horns
+            if(headDist < 0.1f) c = PACK_RGB(110, 60, 30); // Head
+            if(ny > 0.27f && ny < 0.31f && cx > 0.03f && cx < 0.06f) c = PACK_RGB(255, 30, 0); // Eyes
+            if(ny > 0.38f && ny < 0.7f && cx < 0.16f - (ny - 0.38f) * 0.15f) c = PACK_RGB(90, 45, 20); // Torso
+            if(ny > 0.4f && ny < 0.62f && cx > 0.16f && cx < 0.22f) c = PACK_RGB(110, 60, 30); // Arms
+            if(ny >= 0.7f && ny < 0.98f && cx > 0.03f && cx < 0.1f) c = PACK_RGB(70, 35, 15); // Legs
+            img->texels[x * size + y] = c;
+        }
+    }
+    findSpriteSpans(img);
+}
+
+void initSprites()
+{
+    const PackEntry *key = findAsset("key");
+    const PackEntry *minotaur = findAsset("minotaur");
+
+    if(key) loadSpriteImage(&keyImage, key);
+    else rasterizeKeyShape(&keyImage, 32);
+    if(minotaur) loadSpriteImage(&minotaurImage, minotaur);
+    else rasterizeMinotaurShape(&minotaurImage, 32);
+}
+
+// A sprite projected for this frame
+typedef struct {
+    const SpriteImage *image;
+    float depth; // Perpendicular distance, comparable with depthBuffer
+    float left, top; // Screen position of the image's top-left corner
+    float size; // On-screen width and height in pixels
+} SpriteDraw;
+
+SpriteDraw *spriteDraws = NULL;
+int spriteDrawCount = 0, spriteDrawCapacity = 0;
+
+int compareSpriteDepth(const void *a, const void *b)
+{
+    float da = ((const SpriteDraw *)a)->depth, db = ((const SpriteDraw *)b)->depth;
+    return (da < db) - (da > db); // Farthest first
+}
+
+// Draws one sprite as scaled column spans. Columns behind a wall are rejected from
+// depthBuffer before any texel is read, and only each column's opaque rows are visited.
+void drawSpriteColumns(const SpriteDraw *d)
+{
+    const SpriteImage *img = d->image;
+    float texelsPerPixel = img->width / d->size;
+    uint32_t texStep = (uint32_t)(img->height * 65536.0f / d->size); // 16.16 rows per pixel
+    int xStart = (int)ceilf(d->left - 0.5f);
+    int xEnd = (int)ceilf(d->left + d->size - 0.5f);
+    const uint8_t *light = colormap[lightLevel(d->depth, 1.0f)]; // Indexed colour only
+    int x, y;
+
+    if(xStart < 0) xStart = 0;
+    if(xEnd > renderW) xEnd = renderW;
+
+    for(x = xStart; x < xEnd; x++)
+    {
+        const uint32_t *tex;
+        uint32_t *column;
+        uint32_t texPos;
+        int texX, yStart, yEnd;
+
+        if(d->depth >= depthBuffer[x]) continue;
+
+        texX = (int)((x + 0.5f - d->left) * texelsPerPixel);
+        if(texX >= img->width) texX = img->width - 1;
+        if(img->top[texX] == img->bottom[texX]) continue;
+
+        // Screen rows covering the opaque part of this texture column
+        yStart = (int)ceilf(d->top + img->top[texX] * d->size / img->height - 0.5f);
+        yEnd = (int)ceilf(d->top + img->bottom[texX] * d->size / img->height - 0.5f);
+        if(yStart < 0) yStart = 0;
+        if(yEnd > renderH) yEnd = renderH;
+
+        tex = img->texels + texX * img->height;
+        texPos = (uint32_t)((yStart + 0.5f - d->top) * texStep);
+        if(indexedColor)
+        {
+            const uint8_t *indices = img->indices + texX * img->height;
+            uint8_t *pixels = indexColumn(x);
+            for(y = yStart; y < yEnd; y++)
+            {
+                if(tex[texPos >> 16] >> 24) pixels[y] = light[indices[texPos >> 16]];
+                texPos += texStep;
+            }
+            continue;
+        }
+        column = frameColumn(x);
+        for(y = yStart; y < yEnd; y++)
+        {
+            uint32_t c = tex[texPos >> 16];
+            if(c >> 24) column[y] = c;
+            texPos += texStep;
+        }
+    }
+}
+
+// Adds a sprite to this frame's draw list if it is in front of the camera and on screen
+void projectSprite(const Sprite *s)
+{
+    SpriteDraw *d;
+    float spx = s->x - viewX, spy = s->y - viewY;
+    float side, screenX;
+
+    if(!s->active) return;
+    if(spriteDrawCount == spriteDrawCapacity) {
+        spriteDrawCapacity = spriteDrawCapacity ? spriteDrawCapacity * 2 : 64;
+        spriteDraws = (SpriteDraw *)allocOrDie(spriteDraws, spriteDrawCapacity * sizeof(SpriteDraw));
+    }
+    d = &spriteDraws[spriteDrawCount];
+
+    // Camera space: perpendicular depth and sideways offset in units of the
+    // half screen width at that depth
+    d->depth = spx * camera.fwdX + spy * camera.fwdY;
+    if(d->depth < 1) return;
+    side = (spx * camera.rightX + spy * camera.rightY) / (camera.tanHalfFov * camera.tanHalfFov);
+
+    d->size = (mapS * renderH) / d->depth;
+    screenX = renderW / 2.0f * (1.0f + side / d->depth);
+    if(screenX + d->size / 2 < 0 || screenX - d->size / 2 > renderW) return;
+
+    d->image = s->image;
+    d->left = screenX - d->size / 2;
+    d->top = renderH / 2.0f - d->size / 2;
+    spriteDrawCount++;
+}
+
+// Fills spriteDraws with the entities in cells the rays reached this frame that are in
+// front of the camera and on screen, farthest first
+void projectVisibleSprites()
+{
+    int i, id;
+
+    spriteDrawCount = 0;
+    for(i = 0; i < visibleCells.count; i++) {
+        for(id = cellEntities[visibleCells.cells[i]]; id >= 0; id = entities[id].next) projectSprite(&entities[id]);
+    }
+    if(spriteDrawCount > 1) qsort(spriteDraws, spriteDrawCount, sizeof(SpriteDraw), compareSpriteDepth);
+}
+
+// Draws the entities in cells the rays reached this frame, back to front, over the walls
+void drawEntities()
+{
+    int i;
+
+    updateCameraTable();
+    projectVisibleSprites();
+    for(i = 0; i < spriteDrawCount; i++) drawSpriteColumns(&spriteDraws[i]);
+}
+
+// GPU RENDERING
+
+// Alternative to the CPU passes above, picked with -renderer gpu or toggled with 'g':
+// a single full-window quad whose fragment shader draws the whole 3D view. The map
+// layers are integer textures (one R8UI texel per cell, plus the chunk table in endless
+// mode), material n is layer n of a texture array, and the sprites projected on the CPU
+// arrive as a uniform array, nearest first, each with its layer of the sprite array
+// texture. The shader repeats the CPU arithmetic: one ray per column group, the same
+// row distances, mip choice and side shade, so both paths draw the same frame up to
+// float rounding. Needs GLSL 1.30 (llvmpipe will do).
+#ifndef HEADLESS
+#define GPU_MAX_SPRITES 64 // Nearest sprites composited per frame
+#define GPU_SPRITE_LAYERS 2
+
+const SpriteImage *gpuSpriteImages[GPU_SPRITE_LAYERS] = { &keyImage, &minotaurImage }; // Sprite array layers
+
+int useGpu = 0; // Draw the 3D view with the shader
+int gpuReady = 0; // 1: initialised, -1: failed, don't retry
+
+GLuint gpuProgram, gpuMapTex, gpuFloorTex, gpuCeilingTex, gpuSlotTex, gpuSurfaceTex, gpuSpriteTex;
+// Locations of the uniforms set every frame, looked up once after linking
+static GLint uEndless, uMaxSteps, uMapSize, uScreenSize, uRenderSize, uColumnW, uViewPos, uFwd, uRight;
+static GLint uSpriteCount, uSprites, uSpriteLayers;
+int gpuMapVersion = -1, gpuMapW, gpuMapH; // What the map layer textures hold
+int gpuTexSize, gpuTexLevels, gpuLayers; // Surface array layer size, mip count and layers
+int gpuSpriteW, gpuSpriteH; // Sprite array layer size
+
+// GL 2.0+ entry points, looked up at run time (not exported by every GL 1.1 library)
+PFNGLCREATESHADERPROC pglCreateShader;
+PFNGLSHADERSOURCEPROC pglShaderSource;
+PFNGLCOMPILESHADERPROC pglCompileShader;
+PFNGLGETSHADERIVPROC pglGetShaderiv;
+PFNGLGETSHADERINFOLOGPROC pglGetShaderInfoLog;
+PFNGLCREATEPROGRAMPROC pglCreateProgram;
+PFNGLATTACHSHADERPROC pglAttachShader;
+PFNGLLINKPROGRAMPROC pglLinkProgram;
+PFNGLGETPROGRAMIVPROC pglGetProgramiv;
+PFNGLGETPROGRAMINFOLOGPROC pglGetProgramInfoLog;
+PFNGLUSEPROGRAMPROC pglUseProgram;
+PFNGLGETUNIFORMLOCATIONPROC pglGetUniformLocation;
+PFNGLUNIFORM1IPROC pglUniform1i;
+PFNGLUNIFORM1FPROC pglUniform1f;
+PFNGLUNIFORM2IPROC pglUniform2i;
+PFNGLUNIFORM2FPROC pglUniform2f;
+PFNGLUNIFORM1IVPROC pglUniform1iv;
+PFNGLUNIFORM4FVPROC pglUniform4fv;
+PFNGLACTIVETEXTUREPROC pglActiveTexture;
+PFNGLTEXIMAGE3DPROC pglTexImage3D;
+PFNGLGENERATEMIPMAPPROC pglGenerateMipmap;
+
+// glutGetProcAddress() returns void (*)(), and casting that straight to a prototyped
+// type trips -Wcast-function-type; casts from void (*)(void) are exempt
+typedef void (*GlProc)(void);
+
+GlProc glProc(const char *name)
+{
+    return (GlProc)glutGetProcAddress(name);
+}
+
+const char *gpuVertexSource =
+    "#version 130\n"
+    "void main() { gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex; }\n";
+
+// Constants are prepended as #defines: MAP_S, TEX_REPEAT, MAX_SPRITES, SIDE_SHADE,
+// MATERIAL_FLOOR, MATERIAL_CEILING
+const char *gpuFragmentSource =
+    "uniform usampler2D mapTex, floorTex, ceilingTex;\n" // Map layers; in endless mode the wrapped window
+    "uniform isampler2D slotTex;\n" // Endless: world chunk held by each slot, -1 if none
+    "uniform sampler2DArray surfaceTex;\n" // Layer n is material n
+    "uniform sampler2DArray spriteTex;\n" // Layer n is gpuSpriteImages[n], transposed (s down a column)
+    "uniform int endless, maxSteps, texLevels, spriteCount;\n"
+    "uniform ivec2 mapSize, spriteSize;\n"
+    "uniform vec2 screenSize, renderSize, viewPos, fwd, right;\n"
+    "uniform float columnW, texSize;\n"
+    "uniform vec4 sprites[MAX_SPRITES];\n" // left, top, size, depth in framebuffer pixels
+    "uniform int spriteLayers[MAX_SPRITES];\n"
+    "\n"
+    "int cellAt(usampler2D layer, ivec2 m) {\n" // cellIndex(): -1 off the map or in a chunk not loaded
+    "    if(m.x < 0 || m.y < 0) return -1;\n"
+    "    if(endless != 0) {\n"
+    "        ivec2 chunk = m / CHUNK_CELLS;\n"
+    "        if(texelFetch(slotTex, chunk % CHUNK_SLOTS, 0).xy != chunk) return -1;\n"
+    "        m %= mapSize;\n"
+    "    } else if(m.x >= mapSize.x || m.y >= mapSize.y) return -1;\n"
+    "    return int(texelFetch(layer, m, 0).r);\n"
+    "}\n"
+    "\n"
+    "int mipLevel(float texelsPerSample) {\n"
+    "    int level = 0;\n"
+    "    while(texelsPerSample >= 2.0 && level < texLevels - 1) { texelsPerSample *= 0.5; level++; }\n"
+    "    return level;\n"
+    "}\n"
+    "\n"
+    "vec4 surface(vec2 texel, int layer, int level) {\n"
+    "    int size = int(texSize) >> level;\n"
+    "    if(layer >= LAYERS) layer = MATERIAL_WALL;\n" // Values with no T_n share material 1
+    "    return texelFetch(surfaceTex, ivec3(ivec2(floor(texel)) & (size - 1), layer), level);\n"
+    "}\n"
+    "\n"
+    "void main() {\n"
+    "    ivec2 pix = ivec2(floor(vec2(gl_FragCoord.x, screenSize.y - gl_FragCoord.y) * renderSize / screenSize));\n"
+    "    float column = floor(float(pix.x) / columnW);\n"
+    "    float cameraX = (2.0 * column * columnW + columnW) / renderSize.x - 1.0;\n"
+    "    vec2 rayStep = fwd + right * cameraX;\n"
+    "    float fisheye = 1.0 / length(rayStep);\n"
+    "    vec2 dir = rayStep * fisheye;\n"
+    "\n"
+    // castRay(): Amanatides-Woo traversal
+    "    ivec2 m = ivec2(floor(viewPos / MAP_S));\n"
+    "    ivec2 stepDir = ivec2(dir.x < 0.0 ? -1 : 1, dir.y < 0.0 ? -1 : 1);\n"
+    "    vec2 tDelta = vec2(abs(dir.x) > 1e-9 ? abs(MAP_S / dir.x) : 1e30, abs(dir.y) > 1e-9 ? abs(MAP_S / dir.y) : 1e30);\n"
+    "    vec2 tMax;\n"
+    "    tMax.x = abs(dir.x) <= 1e-9 ? 1e30 : dir.x < 0.0 ? (viewPos.x - float(m.x) * MAP_S) / -dir.x : (float(m.x + 1) * MAP_S - viewPos.x) / dir.x;\n"
+    "    tMax.y = abs(dir.y) <= 1e-9 ? 1e30 : dir.y < 0.0 ? (viewPos.y - float(m.y) * MAP_S) / -dir.y : (float(m.y + 1) * MAP_S - viewPos.y) / dir.y;\n"
+    "    float t = 0.0;\n"
+    "    int side = 0, cell = 0;\n"
+    "    for(int i = 0; i < maxSteps; i++) {\n"
+    "        if(tMax.x < tMax.y) { m.x += stepDir.x; t = tMax.x; tMax.x += tDelta.x; side = 0; }\n"
+    "        else { m.y += stepDir.y; t = tMax.y; tMax.y += tDelta.y; side = 1; }\n"
+    "        cell = cellAt(mapTex, m);\n"
+    "        if(cell < 0) { cell = endless != 0 ? 1 : 0; break; }\n"
+    "        if(cell != 0) break;\n"
+    "    }\n"
+    "    vec2 hit = viewPos + dir * t;\n"
+    "    float texU = fract((side == 0 ? hit.y : hit.x) / TEX_REPEAT);\n"
+    "    float disT = max(t * fisheye, 1e-3);\n"
+    "    float lineH = MAP_S * renderSize.y / disT;\n"
+    "    float lineOff = renderSize.y / 2.0 - lineH / 2.0;\n"
+    "\n"
+    "    vec3 color = vec3(51.0 / 255.0);\n"
+    "    if(pix.y < int(lineOff) || pix.y >= int(lineOff + lineH)) {\n"
+    // Floor or ceiling: the world point under this row, as drawFloorRows() finds it
+    "        float dy = abs(float(pix.y) - renderSize.y / 2.0);\n"
+    "        if(dy >= 1e-6) {\n"
+    "            float rowDist = (MAP_S * renderSize.y / 2.0) / dy;\n"
+    "            float spacing = length(right) * 2.0 * columnW / renderSize.x * texSize / TEX_REPEAT;\n"
+    "            int level = mipLevel(rowDist * spacing);\n"
+    "            vec2 world = viewPos + rayStep * rowDist;\n"
+    "            ivec2 under = ivec2(floor(world / MAP_S));\n"
+    "            int material;\n"
+    "            if(pix.y < int(lineOff)) { material = cellAt(ceilingTex, under); if(material < 0) material = MATERIAL_CEILING; }\n"
+    "            else { material = cellAt(floorTex, under); if(material < 0) material = MATERIAL_FLOOR; }\n"
+    "            color = surface(world * float(int(texSize) >> level) / TEX_REPEAT, material, level).rgb;\n"
+    "        }\n"
+    "    } else {\n"
+    "        int level = mipLevel(texSize / lineH);\n"
+    "        float size = float(int(texSize) >> level);\n"
+    "        color = surface(vec2(texU * size, (float(pix.y) - lineOff) * size / lineH), cell, level).rgb;\n"
+    "        color = floor(color * 255.0 * (side == 0 ? 1.0 : SIDE_SHADE) + 1e-3) / 255.0;\n"
+    "    }\n"
+    "\n"
+    // Sprites nearest first: the first opaque texel in front of the wall wins
+    "    for(int s = 0; s < spriteCount; s++) {\n"
+    "        vec4 sp = sprites[s];\n"
+    "        float x = float(pix.x) + 0.5;\n"
+    "        if(sp.w >= disT || x < ceil(sp.x - 0.5) + 0.5 || x >= ceil(sp.x + sp.z - 0.5) + 0.5) continue;\n"
+    "        int texX = min(int((x - sp.x) * float(spriteSize.x) / sp.z), spriteSize.x - 1);\n"
+    "        int texY = int(floor((float(pix.y) + 0.5 - sp.y) * float(spriteSize.y) / sp.z));\n"
+    "        if(texY < 0 || texY >= spriteSize.y) continue;\n"
+    "        vec4 c = texelFetch(spriteTex, ivec3(texY, texX, spriteLayers[s]), 0);\n"
+    "        if(c.a > 0.0) { color = c.rgb; break; }\n"
+    "    }\n"
+    "    gl_FragColor = vec4(color, 1.0);\n"
+    "}\n";
+
+GLuint compileShader(GLenum type, const char *header, const char *source)
+{
+    const char *parts[2];
+    GLuint shader = pglCreateShader(type);
+    GLint ok;
+    char log[1024];
+
+    parts[0] = header;
+    parts[1] = source;
+    pglShaderSource(shader, 2, parts, NULL);
+    pglCompileShader(shader);
+    pglGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if(!ok) {
+        pglGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        fprintf(stderr, "shader compile failed:\n%s\n", log);
+        return 0;
+    }
+    return shader;
+}
+
+GLuint gpuTexture(GLenum target, GLint filter)
+{
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glBindTexture(target, tex);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    return tex;
+}
+
+// Layers 0 to gpuLayers - 1 are the materials (up to the last T_n in the pack), resized
+// (nearest) to the largest of them since array layers share one size
+void uploadSurfaces()
+{
+    uint32_t *texels;
+    int i, x, y, scale;
+
+    gpuTexSize = 1;
+    gpuLayers = 0;
+    for(i = 0; i < MAX_MATERIALS; i++) {
+        if(hasMaterial(i)) gpuLayers = i + 1;
+        if(materials[i]->flat.mips[0].size > gpuTexSize) gpuTexSize = materials[i]->flat.mips[0].size;
+    }
+    for(gpuTexLevels = 1; (1 << (gpuTexLevels - 1)) < gpuTexSize; gpuTexLevels++);
+
+    texels = (uint32_t *)allocOrDie(NULL, (size_t)gpuTexSize * gpuTexSize * gpuLayers * sizeof(uint32_t));
+    for(i = 0; i < gpuLayers; i++) {
+        const Texture *layer = &materials[i]->flat.mips[0];
+        scale = gpuTexSize / layer->size;
+        for(y = 0; y < gpuTexSize; y++) {
+            for(x = 0; x < gpuTexSize; x++) {
+                texels[((size_t)i * gpuTexSize + y) * gpuTexSize + x] = layer->texels[(y / scale) * layer->size + x / scale];
+            }
+        }
+    }
+    gpuSurfaceTex = gpuTexture(GL_TEXTURE_2D_ARRAY, GL_NEAREST_MIPMAP_NEAREST);
+    pglTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, gpuTexSize, gpuTexSize, gpuLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels);
+    pglGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    free(texels);
+}
+
+// Layer n is gpuSpriteImages[n], column-major like the CPU's copy and resized (nearest)
+// to the largest width and height among them
+void uploadSprites()
+{
+    uint32_t *texels;
+    int i, x, y;
+
+    gpuSpriteW = gpuSpriteH = 1;
+    for(i = 0; i < GPU_SPRITE_LAYERS; i++) {
+        if(gpuSpriteImages[i]->width > gpuSpriteW) gpuSpriteW = gpuSpriteImages[i]->width;
+        if(gpuSpriteImages[i]->height > gpuSpriteH) gpuSpriteH = gpuSpriteImages[i]->height;
+    }
+
+    texels = (uint32_t *)allocOrDie(NULL, (size_t)gpuSpriteW * gpuSpriteH * GPU_SPRITE_LAYERS * sizeof(uint32_t));
+    for(i = 0; i < GPU_SPRITE_LAYERS; i++) {
+        const SpriteImage *img = gpuSpriteImages[i];
+        for(x = 0; x < gpuSpriteW; x++) {
+            for(y = 0; y < gpuSpriteH; y++) {
+                texels[((size_t)i * gpuSpriteW + x) * gpuSpriteH + y] =
+                    img->texels[x * img->width / gpuSpriteW * img->height + y * img->height / gpuSpriteH];
+            }
+        }
+    }
+    gpuSpriteTex = gpuTexture(GL_TEXTURE_2D_ARRAY, GL_NEAREST);
+    pglTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, gpuSpriteH, gpuSpriteW, GPU_SPRITE_LAYERS, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels);
+    free(texels);
+}
+
+// Compiles the shader and uploads the static textures; returns 0 (after saying why)
+// if the GL cannot run it
+int initGpuRenderer()
+{
+    char header[512];
+    const char *version = (const char *)glGetString(GL_SHADING_LANGUAGE_VERSION);
+    GLuint vs, fs;
+    GLint ok;
+    char log[1024];
+
+    pglCreateShader = (PFNGLCREATESHADERPROC)glProc("glCreateShader");
+    pglShaderSource = (PFNGLSHADERSOURCEPROC)glProc("glShaderSource");
+    pglCompileShader = (PFNGLCOMPILESHADERPROC)glProc("glCompileShader");
+    pglGetShaderiv = (PFNGLGETSHADERIVPROC)glProc("glGetShaderiv");
+    pglGetShaderInfoLog = (PFNGLGETSHADERINFOLOGPROC)glProc("glGetShaderInfoLog");
+    pglCreateProgram = (PFNGLCREATEPROGRAMPROC)glProc("glCreateProgram");
+    pglAttachShader = (PFNGLATTACHSHADERPROC)glProc("glAttachShader");
+    pglLinkProgram = (PFNGLLINKPROGRAMPROC)glProc("glLinkProgram");
+    pglGetProgramiv = (PFNGLGETPROGRAMIVPROC)glProc("glGetProgramiv");
+    pglGetProgramInfoLog = (PFNGLGETPROGRAMINFOLOGPROC)glProc("glGetProgramInfoLog");
+    pglUseProgram = (PFNGLUSEPROGRAMPROC)glProc("glUseProgram");
+    pglGetUniformLocation = (PFNGLGETUNIFORMLOCATIONPROC)glProc("glGetUniformLocation");
+    pglUniform1i = (PFNGLUNIFORM1IPROC)glProc("glUniform1i");
+    pglUniform1f = (PFNGLUNIFORM1FPROC)glProc("glUniform1f");
+    pglUniform2i = (PFNGLUNIFORM2IPROC)glProc("glUniform2i");
+    pglUniform2f = (PFNGLUNIFORM2FPROC)glProc("glUniform2f");
+    pglUniform1iv = (PFNGLUNIFORM1IVPROC)glProc("glUniform1iv");
+    pglUniform4fv = (PFNGLUNIFORM4FVPROC)glProc("glUniform4fv");
+    pglActiveTexture = (PFNGLACTIVETEXTUREPROC)glProc("glActiveTexture");
+    pglTexImage3D = (PFNGLTEXIMAGE3DPROC)glProc("glTexImage3D");
+    pglGenerateMipmap = (PFNGLGENERATEMIPMAPPROC)glProc("glGenerateMipmap");
+    if(!version || atof(version) < 1.3 || !pglCreateShader || !pglShaderSource || !pglCompileShader ||
+       !pglGetShaderiv || !pglGetShaderInfoLog || !pglCreateProgram || !pglAttachShader || !pglLinkProgram ||
+       !pglGetProgramiv || !pglGetProgramInfoLog || !pglUseProgram || !pglGetUniformLocation || !pglUniform1i ||
+       !pglUniform1f || !pglUniform2i || !pglUniform2f || !pglUniform1iv || !pglUniform4fv || !pglActiveTexture ||
+       !pglTexImage3D || !pglGenerateMipmap) {
+        fprintf(stderr, "GPU renderer needs OpenGL 3.0 / GLSL 1.30 (have %s)\n", version ? version : "none");
+        return 0;
+    }
+
+    // The surfaces go first: the shader is told how many layers there are
+    pglActiveTexture(GL_TEXTURE2);
+    uploadSurfaces();
+
+    sprintf(header, "#version 130\n#define MAP_S %d.0\n#define TEX_REPEAT %.1f\n#define MAX_SPRITES %d\n"
+            "#define SIDE_SHADE %.3f\n#define CHUNK_CELLS %d\n#define CHUNK_SLOTS %d\n#define LAYERS %d\n"
+            "#define MATERIAL_WALL %d\n#define MATERIAL_FLOOR %d\n#define MATERIAL_CEILING %d\n",
+            mapS, TEX_REPEAT, GPU_MAX_SPRITES, shadeLevels[1], CHUNK_CELLS, CHUNK_SLOTS, gpuLayers,
+            MATERIAL_WALL, MATERIAL_FLOOR, MATERIAL_CEILING);
+    vs = compileShader(GL_VERTEX_SHADER, "", gpuVertexSource);
+    fs = compileShader(GL_FRAGMENT_SHADER, header, gpuFragmentSource);
+    if(!vs || !fs) return 0;
+    gpuProgram = pglCreateProgram();
+    pglAttachShader(gpuProgram, vs);
+    pglAttachShader(gpuProgram, fs);
+    pglLinkProgram(gpuProgram);
+    pglGetProgramiv(gpuProgram, GL_LINK_STATUS, &ok);
+    if(!ok) {
+        pglGetProgramInfoLog(gpuProgram, sizeof(log), NULL, log);
+        fprintf(stderr, "shader link failed:\n%s\n", log);
+        return 0;
+    }
+
+    pglActiveTexture(GL_TEXTURE3);
+    uploadSprites();
+    pglActiveTexture(GL_TEXTURE5);
+    gpuCeilingTex = gpuTexture(GL_TEXTURE_2D, GL_NEAREST);
+    pglActiveTexture(GL_TEXTURE4);
+    gpuFloorTex = gpuTexture(GL_TEXTURE_2D, GL_NEAREST);
+    pglActiveTexture(GL_TEXTURE1);
+    gpuSlotTex = gpuTexture(GL_TEXTURE_2D, GL_NEAREST);
+    pglActiveTexture(GL_TEXTURE0);
+    gpuMapTex = gpuTexture(GL_TEXTURE_2D, GL_NEAREST);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // R8UI rows of any width
+
+    uEndless = pglGetUniformLocation(gpuProgram, "endless");
+    uMaxSteps = pglGetUniformLocation(gpuProgram, "maxSteps");
+    uMapSize = pglGetUniformLocation(gpuProgram, "mapSize");
+    uScreenSize = pglGetUniformLocation(gpuProgram, "screenSize");
+    uRenderSize = pglGetUniformLocation(gpuProgram, "renderSize");
+    uColumnW = pglGetUniformLocation(gpuProgram, "columnW");
+    uViewPos = pglGetUniformLocation(gpuProgram, "viewPos");
+    uFwd = pglGetUniformLocation(gpuProgram, "fwd");
+    uRight = pglGetUniformLocation(gpuProgram, "right");
+    uSpriteCount = pglGetUniformLocation(gpuProgram, "spriteCount");
+    uSprites = pglGetUniformLocation(gpuProgram, "sprites");
+    uSpriteLayers = pglGetUniformLocation(gpuProgram, "spriteLayers");
+
+    pglUseProgram(gpuProgram);
+    pglUniform1i(pglGetUniformLocation(gpuProgram, "mapTex"), 0);
+    pglUniform1i(pglGetUniformLocation(gpuProgram, "slotTex"), 1);
+    pglUniform1i(pglGetUniformLocation(gpuProgram, "surfaceTex"), 2);
+    pglUniform1i(pglGetUniformLocation(gpuProgram, "spriteTex"), 3);
+    pglUniform1i(pglGetUniformLocation(gpuProgram, "floorTex"), 4);
+    pglUniform1i(pglGetUniformLocation(gpuProgram, "ceilingTex"), 5);
+    pglUniform1f(pglGetUniformLocation(gpuProgram, "texSize"), (float)gpuTexSize);
+    pglUniform1i(pglGetUniformLocation(gpuProgram, "texLevels"), gpuTexLevels);
+    pglUniform2i(pglGetUniformLocation(gpuProgram, "spriteSize"), gpuSpriteW, gpuSpriteH);
+    pglUseProgram(0);
+    return 1;
+}
+
+// Refreshes the map layer textures after the map changed, and the chunk table in
+// endless mode
+void uploadGpuMap()
+{
+    pglActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, gpuMapTex);
+    if(gpuMapVersion != mapVersion || gpuMapW != mapX || gpuMapH != mapY) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, mapX, mapY, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, map);
+        pglActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D, gpuFloorTex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, mapX, mapY, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, mapFloor);
+        pglActiveTexture(GL_TEXTURE5);
+        glBindTexture(GL_TEXTURE_2D, gpuCeilingTex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, mapX, mapY, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, mapCeiling);
+        pglActiveTexture(GL_TEXTURE0);
+        gpuMapVersion = mapVersion;
+        gpuMapW = mapX;
+        gpuMapH = mapY;
+    }
+    if(endless) {
+        GLint slots[CHUNK_SLOTS * CHUNK_SLOTS * 2];
+        int i;
+        for(i = 0; i < CHUNK_SLOTS * CHUNK_SLOTS; i++) {
+            slots[i * 2] = chunkSlots[i].ready ? chunkSlots[i].cx : -1;
+            slots[i * 2 + 1] = chunkSlots[i].ready ? chunkSlots[i].cy : -1;
+        }
+        pglActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, gpuSlotTex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32I, CHUNK_SLOTS, CHUNK_SLOTS, 0, GL_RG_INTEGER, GL_INT, slots);
+        pglActiveTexture(GL_TEXTURE0);
+    }
+}
+
+// Draws the 3D view over the whole window in one draw call
+void drawGpuView()
+{
+    static float spriteData[GPU_MAX_SPRITES * 4];
+    static GLint spriteLayers[GPU_MAX_SPRITES];
+    int i, layer, count = 0;
+
+    // The CPU rays cost little next to the shader and give the cells in view, so sprites
+    // behind walls do not take up the GPU_MAX_SPRITES slots
+    castRays();
+    uploadGpuMap();
+
+    // Farthest first, so the nearest GPU_MAX_SPRITES are at the end
+    projectVisibleSprites();
+    for(i = spriteDrawCount - 1; i >= 0 && count < GPU_MAX_SPRITES; i--, count++) {
+        spriteData[count * 4] = spriteDraws[i].left;
+        spriteData[count * 4 + 1] = spriteDraws[i].top;
+        spriteData[count * 4 + 2] = spriteDraws[i].size;
+        spriteData[count * 4 + 3] = spriteDraws[i].depth;
+        for(layer = GPU_SPRITE_LAYERS - 1; layer > 0 && gpuSpriteImages[layer] != spriteDraws[i].image; layer--);
+        spriteLayers[count] = layer;
+    }
+
+    pglUseProgram(gpuProgram);
+    pglUniform1i(uEndless, endless);
+    pglUniform1i(uMaxSteps, mapX + mapY + 2);
+    pglUniform2i(uMapSize, mapX, mapY);
+    pglUniform2f(uScreenSize, (float)screenW, (float)screenH);
+    pglUniform2f(uRenderSize, (float)renderW, (float)renderH);
+    pglUniform1f(uColumnW, (float)columnW);
+    pglUniform2f(uViewPos, viewX, viewY);
+    pglUniform2f(uFwd, camera.fwdX, camera.fwdY);
+    pglUniform2f(uRight, camera.rightX, camera.rightY);
+    pglUniform1i(uSpriteCount, count);
+    if(count) {
+        pglUniform4fv(uSprites, count, spriteData);
+        pglUniform1iv(uSpriteLayers, count, spriteLayers);
+    }
+
+    glBegin(GL_QUADS);
+    glVertex2i(0, 0);
+    glVertex2i(screenW, 0);
+    glVertex2i(screenW, screenH);
+    glVertex2i(0, screenH);
+    glEnd();
+    pglUseProgram(0);
+}
+#endif // !HEADLESS
+
+// PURSUIT
+
+// Minotaurs chase the player through one flow field shared by all of them: mapFlow
+// holds, for every open cell, the step towards the player's cell, found by a
+// breadth-first search rooted there. When the player enters another cell a new
+// search starts and expands FLOW_BUDGET cells per tick, overwriting the old field in
+// place, so the cost of a tick does not grow with the maze. Cells the search has not
+// reached yet keep their old step, which still ends next to the player; a step only
+// ever leads to a cell searched no earlier and closer to its root, so following the
+// field never loops. Each minotaur then reads one cell of it per tick.
+#define FLOW_HERE 4 // The search root, the player's cell
+#define FLOW_NONE 255 // Never reached: a wall or cut off from the player
+#define FLOW_BUDGET 4096 // Cells expanded per tick
+#define MINOTAUR_SPEED 2.0f // World units per tick; the player walks 3
+#define MINOTAUR_CATCH 20.0f // Distance at which a minotaur catches the player
+#define MINOTAUR_DENSITY 256 // Open cells per minotaur unless -minotaurs says otherwise
+#define MINOTAUR_SPAWN_FRACTION 2 // Minotaurs start at least half the farthest distance from the spawn
+
+int *minotaurs = NULL; // Entity ids of this round's minotaurs
+int minotaurCount = 0;
+uint16_t flowSearch = 0; // Stamp of the current search
+int flowRoot = -1; // Cell the current search started from
+int flowHead = 0, flowTail = 0; // Expanded and reached cells of flowQueue
+
+// Starts a search from the player's new cell; the last one's steps stay in place
+void startFlowSearch(int root)
+{
+    if(++flowSearch == 0) {
+        // Stamps wrapped: forget which cells the old searches reached
+        memset(flowStamp, 0, (size_t)mapX * mapY * sizeof(uint16_t));
+        flowSearch = 1;
+    }
+    flowRoot = root;
+    flowStamp[root] = flowSearch;
+    mapFlow[root] = FLOW_HERE;
+    flowQueue[0] = root;
+    flowHead = 0;
+    flowTail = 1;
+}
+
+// Expands up to 'budget' cells of the current search
+void advanceFlowSearch(int budget)
+{
+    int step[4], d;
+
+    step[0] = 1; step[1] = -1; step[2] = mapX; step[3] = -mapX;
+    for(; budget > 0 && flowHead < flowTail; budget--)
+    {
+        // The border is always solid, so neighbours never leave the map
+        int cell = flowQueue[flowHead++];
+        for(d = 0; d < 4; d++) {
+            int n = cell + step[d];
+            if(flowStamp[n] != flowSearch && !isSolidCell(n)) {
+                flowStamp[n] = flowSearch;
+                mapFlow[n] = (uint8_t)(d ^ 1); // Back the way the search came
+                flowQueue[flowTail++] = n;
+            }
+        }
+    }
+}
+
+// Clears the field and the minotaurs for a new round
+void resetPursuit()
+{
+    memset(mapFlow, FLOW_NONE, (size_t)mapX * mapY);
+    memset(flowStamp, 0, (size_t)mapX * mapY * sizeof(uint16_t));
+    flowSearch = 0;
+    flowRoot = -1;
+    minotaurCount = 0;
+}
+
+// Puts the round's minotaurs in random open cells far from the spawn and searches the
+// whole maze once, so they know their way from the first tick
+void spawnMinotaurs()
+{
+    int count = minotaurOption >= 0 ? minotaurOption : openCount / MINOTAUR_DENSITY + 1;
+    int from = firstOpenCellAt(spawnDist[openCells[openCount - 1]] / MINOTAUR_SPAWN_FRACTION);
+
+    if(count == 0 || from >= openCount) return; // None wanted, or a maze of one cell
+    minotaurs = (int *)allocOrDie(minotaurs, count * sizeof(int));
+    for(minotaurCount = 0; minotaurCount < count; minotaurCount++) {
+        int cell = openCells[from + (int)rngRange(&gameRng, openCount - from)];
+        minotaurs[minotaurCount] = addEntity(cell % mapX * mapS + mapS / 2.0f, cell / mapX * mapS + mapS / 2.0f,
+                                             ENTITY_MINOTAUR, &minotaurImage);
+    }
+
+    startFlowSearch(cellOf(px, py));
+    advanceFlowSearch(openCount);
+}
+
+// Moves every minotaur one tick along the field and sets gameCaught if one reaches
+// the player. Returns whether one moved in or into a cell seen last frame.
+int updatePursuers()
+{
+    int step[4], i, seen = 0;
+    int cell = cellOf(px, py);
+
+    if(minotaurCount == 0) return 0;
+    if(cell != flowRoot) startFlowSearch(cell);
+    advanceFlowSearch(FLOW_BUDGET);
+
+    step[0] = 1; step[1] = -1; step[2] = mapX; step[3] = -mapX;
+    for(i = 0; i < minotaurCount; i++)
+    {
+        Sprite *s = &entities[minotaurs[i]];
+        int dir = mapFlow[s->cell];
+        float tx, ty, dx, dy, len;
+
+        if(dir == FLOW_NONE) continue; // Cut off from the player
+        if(dir == FLOW_HERE) {
+            tx = px;
+            ty = py;
+        } else {
+            // Heading for the centre of the next cell keeps it inside the two cells
+            int next = s->cell + step[dir];
+            tx = next % mapX * mapS + mapS / 2.0f;
+            ty = next / mapX * mapS + mapS / 2.0f;
+        }
+        dx = tx - s->x;
+        dy = ty - s->y;
+        len = sqrtf(dx*dx + dy*dy);
+        if(len > MINOTAUR_SPEED) {
+            dx *= MINOTAUR_SPEED / len;
+            dy *= MINOTAUR_SPEED / len;
+        }
+        if(len > 0 && !isSolidCell(cellOf(s->x + dx, s->y + dy))) {
+            seen |= (cellSeen[s->cell >> 5] >> (s->cell & 31)) & 1;
+            moveEntity(minotaurs[i], s->x + dx, s->y + dy);
+            seen |= (cellSeen[s->cell >> 5] >> (s->cell & 31)) & 1;
+        }
+        if(dist(px, py, s->x, s->y) < MINOTAUR_CATCH) gameCaught = 1;
+    }
+    return seen;
+}
+
+// LOGIC
+
+// The game advances in fixed ticks of TICK_MS whatever the frame rate, so speeds are
+// per tick. Frames fall between ticks and draw the pose blended from the previous
+// tick to the current one.
+#define TICK_MS 16.0 // Simulation step, the old timer period
+#define MAX_TICKS_PER_FRAME 8 // Beyond this the game slows down rather than spiral
+
+void savePose()
+{
+    prevX = px;
+    prevY = py;
+    prevA = pa;
+}
+
+// Sets the view pose alpha of the way from the previous tick to the current one
+void interpolateView(float alpha)
+{
+    float turn = pa - prevA;
+
+    if(turn > PI) turn -= 2*PI; // Shortest way round
+    if(turn < -PI) turn += 2*PI;
+    viewX = prevX + (px - prevX) * alpha;
+    viewY = prevY + (py - prevY) * alpha;
+    viewA = FixAng(prevA + turn * alpha);
+}
+
+// Advances the game by one tick; returns whether the screen changed
+int updateMovement()
+{
+    float walkSpeed = 3.0f;
+    float rotSpeed = 0.05f;
+    float newX, newY;
+    int moved = 0;
+    int mx, my, cx, cy, id, next;
+    
+    if(!gameStarted || gameWon || gameCaught || gameIntro) return 0;
+    
+    newX = px;
+    newY = py;
+
+    // Rotation
+    if(keyStates['a']) {
+        pa -= rotSpeed;
+        if(pa < 0) { pa += 2*PI; }
+        pdx = cosf(pa)*5.0f;
+        pdy = sinf(pa)*5.0f;
+        moved = 1;
+    }
+    if(keyStates['d']) {
+        pa += rotSpeed;
+        if(pa > 2*PI) { pa -= 2*PI; }
+        pdx = cosf(pa)*5.0f;
+        pdy = sinf(pa)*5.0f;
+        moved = 1;
+    }
+
+    // Movement
+    if(keyStates['w']) {
+        newX += cosf(pa) * walkSpeed;
+        newY += sinf(pa) * walkSpeed;
+        moved = 1;
+    }
+    if(keyStates['s']) {
+        newX -= cosf(pa) * walkSpeed;
+        newY -= sinf(pa) * walkSpeed;
+        moved = 1;
+    }
+
+    // Collision check and update player
+    if(!checkCollision(newX, newY))
+    {
+        px = newX;
+        py = newY;
+    }
+    if(endless) updateChunks();
+    moved |= updatePursuers();
+    
+    // Check for keys in the player's cell and its neighbours
+    mx = (int)px >> 6;
+    my = (int)py >> 6;
+    for(cy = my - 1; cy <= my + 1; cy++)
+    {
+        for(cx = mx - 1; cx <= mx + 1; cx++)
+        {
+            int cell = cellIndex(cx, cy);
+            if(cell < 0) continue;
+            for(id = cellEntities[cell]; id >= 0; id = next)
+            {
+                next = entities[id].next;
+                if(entities[id].kind == ENTITY_KEY && dist(px, py, entities[id].x, entities[id].y) < 20) // Distance check
+                {
+                    removeEntity(id);
+                    keysCollected++;
+                }
+            }
+        }
+    }
+
+    // Exit check
+    if(playerPassedExitCheck)
+    {
+        // Give a small delay before the win screen appears
+        if (keysCollected >= keysRequired) {
+            gameWon = 1; 
+        } else {
+             playerPassedExitCheck = 0; // Should not happen due to checkCollision, but for safety
+        }
+    }
+
+    return moved || gameWon || gameCaught;
+}
+
+// REPLAY
+
+// A recording is one round: the options and seed that rebuild its maze, then the
+// movement keys held on each simulated tick, run-length coded as (keys, ticks)
+// byte pairs. The header is rewritten when the round ends with the tick count and
+// the final pose, which a replay checks against. Stored little-endian, read as such.
+#define REPLAY_MAGIC "MINOREC1"
+#define REPLAY_VERSION 2 // 2: minotaurs
+#define REPLAY_POS_TOLERANCE 0.01f // World units; same build, same floats
+#define REPLAY_ANGLE_TOLERANCE 1e-4f
+
+typedef struct {
+    char magic[8]; // REPLAY_MAGIC
+    uint32_t version;
+    uint32_t seedLow, seedHigh; // gameSeed of the round
+    uint32_t mapW, mapH, maze, endless; // Options that shape the maze
+    int32_t minotaurs; // -minotaurs of the round
+    uint32_t ticks; // Ticks recorded, 0 while still recording
+    float finalX, finalY, finalA; // Pose after the last tick
+    uint32_t keysCollected; // Keys held after the last tick
+} ReplayHeader;
+
+const char replayKeys[] = "wasd"; // Bit i of a tick's input is keyStates[replayKeys[i]]
+
+FILE *recordFile = NULL;
+const char *recordPath = NULL; // -record: where the next round is recorded
+ReplayHeader recordHeader;
+int recordKeys = -1, recordRun = 0; // Run being coded, -1: none yet
+
+const char *replayPath = NULL; // -replay: recording to play back (headless build)
+const unsigned char *replayData = NULL;
+size_t replaySize = 0, replayPos = 0;
+int replayRun = 0; // Ticks left in the current run
+
+int tickInput()
+{
+    int i, keys = 0;
+    for(i = 0; replayKeys[i]; i++) {
+        if(keyStates[(unsigned char)replayKeys[i]]) keys |= 1 << i;
+    }
+    return keys;
+}
+
+void flushRecordRun()
+{
+    if(recordRun == 0) return;
+    fputc(recordKeys, recordFile);
+    fputc(recordRun, recordFile);
+    recordRun = 0;
+}
+
+// Called before each running tick; the first one opens the file
+void recordTick()
+{
+    int keys = tickInput();
+
+    if(!recordFile)
+    {
+        if(!recordPath || recordHeader.version) return; // Off, or the recorded round is over
+        recordFile = fopen(recordPath, "wb");
+        if(!recordFile) {
+            fprintf(stderr, "cannot record to %s\n", recordPath);
+            recordPath = NULL;
+            return;
+        }
+        memcpy(recordHeader.magic, REPLAY_MAGIC, 8);
+        recordHeader.version = REPLAY_VERSION;
+        recordHeader.seedLow = (uint32_t)gameSeed;
+        recordHeader.seedHigh = (uint32_t)((uint64_t)gameSeed >> 32);
+        recordHeader.mapW = mapX;
+        recordHeader.mapH = mapY;
+        recordHeader.maze = mazeAlgorithm;
+        recordHeader.endless = endless;
+        recordHeader.minotaurs = minotaurOption;
+        fwrite(&recordHeader, sizeof(recordHeader), 1, recordFile);
+    }
+
+    if(keys != recordKeys || recordRun == 255) {
+        flushRecordRun();
+        recordKeys = keys;
+    }
+    recordRun++;
+    recordHeader.ticks++;
+}
+
+// Ends the recording at the current pose: on a win or a catch, or at exit mid-round
+void finishRecording()
+{
+    if(!recordFile) return;
+    flushRecordRun();
+    recordHeader.finalX = px;
+    recordHeader.finalY = py;
+    recordHeader.finalA = pa;
+    recordHeader.keysCollected = keysCollected;
+    fseek(recordFile, 0, SEEK_SET);
+    fwrite(&recordHeader, sizeof(recordHeader), 1, recordFile);
+    fclose(recordFile);
+    recordFile = NULL;
+    printf("recorded %u ticks to %s\n", recordHeader.ticks, recordPath);
+}
+
+const ReplayHeader *replayHeader()
+{
+    return (const ReplayHeader *)replayData;
+}
+
+// Maps a recording and applies its options; returns 0 if it is not a finished one
+int openReplay(const char *path)
+{
+    const ReplayHeader *h;
+    size_t pos;
+    uint64_t ticks = 0;
+
+    replayData = mapFile(path, &replaySize);
+    if(!replayData || replaySize < sizeof(ReplayHeader)) return 0;
+    h = replayHeader();
+    if(memcmp(h->magic, REPLAY_MAGIC, 8) != 0 || h->version != REPLAY_VERSION || h->ticks == 0 ||
+       h->maze >= (uint32_t)MAZE_ALGORITHMS || h->mapW < 5 || h->mapH < 5 ||
+       h->mapW > MAX_MAP_SIZE || h->mapH > MAX_MAP_SIZE) return 0;
+
+    // The runs must be whole, none empty, and cover exactly the ticks in the header
+    if((replaySize - sizeof(ReplayHeader)) % 2) return 0;
+    for(pos = sizeof(ReplayHeader); pos < replaySize; pos += 2) {
+        if(replayData[pos + 1] == 0) return 0;
+        ticks += replayData[pos + 1];
+    }
+    if(ticks != h->ticks) return 0;
+
+    gameSeed = (unsigned long)(((uint64_t)h->seedHigh << 32) | h->seedLow);
+    mapX = h->mapW;
+    mapY = h->mapH;
+    mazeAlgorithm = h->maze;
+    endless = h->endless != 0;
+    minotaurOption = h->minotaurs;
+    chunkSync = endless; // Chunk timing must not depend on the machine
+    replayPos = sizeof(ReplayHeader);
+    replayRun = 0;
+    return 1;
+}
+
+// Sets keyStates for the next tick and runs it; returns 0 past the end
+int replayTick()
+{
+    int i, keys;
+
+    if(replayRun == 0) {
+        if(replayPos + 2 > replaySize) return 0;
+        replayRun = replayData[replayPos + 1];
+        replayPos += 2;
+    }
+    keys = replayData[replayPos - 2];
+    replayRun--;
+    for(i = 0; replayKeys[i]; i++) keyStates[(unsigned char)replayKeys[i]] = (keys >> i) & 1;
+
+    savePose();
+    updateMovement();
+    return 1;
+}
+
+// Compares the state after the last tick with the recording; returns 1 if it matches
+int checkReplay()
+{
+    const ReplayHeader *h = replayHeader();
+    float turn = fabsf(pa - h->finalA);
+    int ok;
+
+    if(turn > PI) turn = 2*PI - turn;
+    ok = fabsf(px - h->finalX) <= REPLAY_POS_TOLERANCE && fabsf(py - h->finalY) <= REPLAY_POS_TOLERANCE &&
+         turn <= REPLAY_ANGLE_TOLERANCE && (uint32_t)keysCollected == h->keysCollected;
+    printf("replay: pose (%.2f, %.2f, %.4f) keys %d, recorded (%.2f, %.2f, %.4f) keys %u: %s\n",
+           px, py, pa, keysCollected, h->finalX, h->finalY, h->finalA, h->keysCollected, ok ? "match" : "MISMATCH");
+    return ok;
+}
+
+#ifndef HEADLESS
+
+// MAIN LOOP
+
+// Timings over the current one-second window, printed with -stats
+typedef struct {
+    double windowStart;
+    int frames, ticks;
+    double frameMs, frameMaxMs; // Sum and worst of the time between frames
+    double tickMs, tickMaxMs; // Sum and worst of the time spent in a tick
+} LoopStats;
+
+LoopStats loopStats;
+double loopTime = 0; // Clock at the last idle() call
+double tickAccumulator = 0; // Time not yet simulated, under one tick after idle()
+double lastFrameTime = 0; // Clock at the start of the last frame
+int viewMoving = 0; // The last tick moved something: frames must keep interpolating
+int redrawPending = 1; // Something changed that no frame shows yet
+
+void printLoopStats(double now)
+{
+    LoopStats *st = &loopStats;
+
+    if(now - st->windowStart < 1000.0) return;
+    if(showStats) {
+        printf("%3d fps (avg %6.2f ms, worst %6.2f ms)  %3d ticks (avg %.3f ms, worst %.3f ms)\n",
+               st->frames, st->frames ? st->frameMs / st->frames : 0.0, st->frameMaxMs,
+               st->ticks, st->ticks ? st->tickMs / st->ticks : 0.0, st->tickMaxMs);
+        fflush(stdout);
+    }
+    memset(st, 0, sizeof(*st));
+    st->windowStart = now;
+}
+
+// Runs the ticks that are due, then either asks for a frame or sleeps until the
+// next tick or frame is due
+void idle()
+{
+    double now = nowMs(), wait;
+    int ticks = 0;
+
+    tickAccumulator += now - loopTime;
+    loopTime = now;
+    while(tickAccumulator >= TICK_MS)
+    {
+        double start;
+        int moved;
+
+        if(ticks++ == MAX_TICKS_PER_FRAME) {
+            tickAccumulator = 0; // Drop the backlog
+            break;
+        }
+        if(gameStarted && !gameWon && !gameCaught && !gameIntro) recordTick();
+        savePose();
+        start = nowMs();
+        PROF_BEGIN(PROF_TICKS);
+        moved = updateMovement();
+        PROF_END(PROF_TICKS);
+        if(gameWon || gameCaught) finishRecording();
+        start = nowMs() - start;
+        loopStats.ticks++;
+        loopStats.tickMs += start;
+        if(start > loopStats.tickMaxMs) loopStats.tickMaxMs = start;
+
+        // The tick where movement stops still needs a frame at its final pose
+        if(moved || viewMoving) redrawPending = 1;
+        viewMoving = moved;
+        tickAccumulator -= TICK_MS;
+    }
+    printLoopStats(now);
+
+    wait = TICK_MS - tickAccumulator;
+    if(redrawPending || viewMoving) {
+        double due = fpsCap > 0 ? lastFrameTime + 1000.0 / fpsCap - now : 0;
+        if(due <= 0) {
+            glutPostRedisplay();
+            return;
+        }
+        if(due < wait) wait = due;
+    }
+    sleepMs(wait);
+}
+
+void display()
+{
+    double now = nowMs();
+
+    if(lastFrameTime > 0) {
+        loopStats.frames++;
+        loopStats.frameMs += now - lastFrameTime;
+        if(now - lastFrameTime > loopStats.frameMaxMs) loopStats.frameMaxMs = now - lastFrameTime;
+    }
+    lastFrameTime = now;
+    redrawPending = 0;
+    PROF_FRAME();
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    
+    if(gameWon)
+    {
+        drawWinScreen();
+    }
+    else if(gameCaught)
+    {
+        drawCaughtScreen();
+    }
+    else if(!gameStarted)
+    {
+        drawStartScreen();
+    }
+    else if(gameIntro)
+    {
+        drawIntroScreen();
+    }
+    else // (Maze + Keys)
+    {
+        double frameStart = nowMs();
+
+        // Draw from partway between the last two ticks
+        interpolateView((float)(tickAccumulator / TICK_MS));
+
+        if(useGpu) {
+            // The shader draws the view straight into the window (timed as the upload)
+            PROF_BEGIN(PROF_UPLOAD);
+            drawGpuView();
+            PROF_END(PROF_UPLOAD);
+        } else {
+            // Dark background (floor/ceiling fallback)
+            PROF_BEGIN(PROF_CLEAR);
+            clearFrame(PACK_RGB(51, 51, 51));
+            PROF_END(PROF_CLEAR);
+            
+            drawRays3D();
+            
+            PROF_BEGIN(PROF_SPRITES);
+            drawEntities();
+            PROF_END(PROF_SPRITES);
+            // Indexed frames become RGBA here, before the graph is drawn over them
+            PROF_BEGIN(PROF_UPLOAD);
+            if(indexedColor) expandFrame();
+            PROF_END(PROF_UPLOAD);
+#ifdef PROFILE
+            if(profOverlay) profDrawGraph();
+#endif
+            
+            // Present the frame in one upload
+            PROF_BEGIN(PROF_UPLOAD);
+            uploadFrame();
+            PROF_END(PROF_UPLOAD);
+        }
+
+        // Draw HUD
+        PROF_BEGIN(PROF_HUD);
+        drawHUD();
+        PROF_END(PROF_HUD);
+#ifdef PROFILE
+        if(profOverlay) profDrawLegend();
+#endif
+
+        // Buffer swap is left out: it may wait for vsync. The GPU path's time is
+        // mostly spent after the draw call returns, so it keeps its resolution.
+        if(!useGpu) updateRenderScale(nowMs() - frameStart);
+    }
+    
+    PROF_BEGIN(PROF_SWAP);
+    glutSwapBuffers();
+    PROF_END(PROF_SWAP);
+}
+#endif
+
+void resetGame() {
+    float keyX, keyY;
+    int i, startCell; 
+    
+    // Everything random below comes from the round's seed
+    rngSeed(&gameRng, gameSeed);
+#ifndef HEADLESS
+    printf("maze seed %lu (%s)\n", gameSeed, endless ? "endless" : mazeAlgorithms[mazeAlgorithm].name);
+#endif
+
+    // Generate a new random map; the endless window starts as solid rock
+    if(endless) mapX = mapY = CHUNK_CELLS * CHUNK_SLOTS;
+    allocMap();
+    if(endless) initializeMap();
+    else {
+        generateMaze(); 
+        placeDoor();    
+    }
+    initializeFloorCeiling(); 
+    mapVersion++;
+
+    // Reset player
+    startCell = endless ? WORLD_CHUNKS / 2 * CHUNK_CELLS + 1 : 1;
+    px = startCell * mapS + mapS/2;
+    py = startCell * mapS + mapS/2;
+    pa = 0;
+    pdx = cosf(pa) * 5.0f;
+    pdy = sinf(pa) * 5.0f;
+    savePose(); // Nothing to interpolate from
+    interpolateView(1.0f);
+    
+    keysCollected = 0;
+    playerPassedExitCheck = 0;
+    clearEntities();
+    resetPursuit();
+
+    // Endless mode has no exit: keys are just found along the way, chunk by chunk
+    if(endless) {
+        keysRequired = 0;
+        startEndless(WORLD_CHUNKS / 2, WORLD_CHUNKS / 2);
+        return;
+    }
+    
+    // Re-initialize key states
+    keysRequired = (int)rngRange(&gameRng, MAX_KEYS) + 1; // Keys required (1-5)
+
+    for(i = 0; i < keysRequired; i++)
+    {
+        if(!findRandomEmptySpot(&keyX, &keyY)) break; // Tiny maze: fewer keys
+        addEntity(keyX, keyY, ENTITY_KEY, &keyImage);
+    }
+    keysRequired = i;
+    spawnMinotaurs();
+}
+
+#ifndef HEADLESS
+
+void keyDown(unsigned char key, int x, int y)
+{
+    if(gameWon || gameCaught)
+    {
+        // Reset game state after the round ends
+        gameWon = 0;
+        gameCaught = 0;
+        gameStarted = 0;
+        gameIntro = 0;
+        
+        gameSeed = rngNext(&gameRng); // Next round gets a fresh layout
+        resetGame(); // Regenerate map, keys, and player position
+        
+        glutPostRedisplay();
+        return;
+    }
+    
+    if(!gameStarted)
+    {
+        // Start Screen > Intro Screen
+        gameStarted = 1;
+        gameIntro = 1; // Set intro state active
+        glutPostRedisplay();
+    }
+    else if(gameIntro)
+    {
+        // Intro Screen > Game
+        gameIntro = 0; // Set intro state inactive, entering main game loop
+        glutPostRedisplay();
+    }
+    
+#ifdef PROFILE
+    if(key == 'p') profOverlay = !profOverlay;
+#endif
+    if(key == 'g') {
+        if(!useGpu && !gpuReady) gpuReady = initGpuRenderer() ? 1 : -1;
+        useGpu = !useGpu && gpuReady > 0;
+        glutPostRedisplay();
+    }
+
+    // Store key state for continuous movement
+    keyStates[key] = 1;
+}
+
+void keyUp(unsigned char key, int x, int y)
+{
+    keyStates[key] = 0;
+}
+
+void resize(int w, int h)
+{
+    glViewport(0, 0, w, h);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluOrtho2D(0, w, h, 0);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    setScreenSize(w, h);
+}
+
+void init()
+{
+    glClearColor(0.3f, 0.3f, 0.3f, 0);
+    gluOrtho2D(0, screenW, screenH, 0); 
+    startWorkers();
+    setScreenSize(screenW, screenH);
+    initFrameTexture();
+    initTextures();
+    initSprites();
+    if(indexedColor) initPalette();
+    if(useGpu) {
+        gpuReady = initGpuRenderer() ? 1 : -1;
+        if(gpuReady < 0) {
+            fprintf(stderr, "falling back to the CPU renderer\n");
+            useGpu = 0;
+        }
+    }
+
+    resetGame(); // Initial game setup
+}
+
+int main(int argc, char* argv[])
+{
+    int i, used;
+
+    // Random layout unless -seed asks for a specific one
+    gameSeed = (unsigned long)time(NULL);
+
+    glutInit(&argc, argv);
+
+    // Render options: -w/-h window size, -fov degrees, -cols pixels per ray,
+    // -budget ms (0: fixed resolution), -threads render threads (0: one per CPU),
+    // -fps frame rate cap (0: none), -stats print loop timings;
+    // game options: -pack asset pack, -map WxH, -seed round seed, -maze generator,
+    // -endless streamed maze, -minotaurs pursuers per round (default: by maze size),
+    // -record file to record the first round's input to,
+    // -renderer gpu to draw the view with a fragment shader ('g' switches),
+    // -indexed 8-bit palette rendering with distance fog
+    for(i = 1; i < argc; i += used) {
+        if(!strcmp(argv[i], "-record") && i + 1 < argc) {
+            recordPath = argv[i + 1];
+            used = 2;
+            continue;
+        }
+        if(!strcmp(argv[i], "-renderer") && i + 1 < argc && (!strcmp(argv[i + 1], "cpu") || !strcmp(argv[i + 1], "gpu"))) {
+            useGpu = !strcmp(argv[i + 1], "gpu");
+            used = 2;
+            continue;
+        }
+        used = parseRenderOption(argc, argv, i);
+        if(!used) {
+            fprintf(stderr, "usage: %s [-record file] [-renderer cpu|gpu] " RENDER_USAGE "\n", argv[0]);
+            return 1;
+        }
+    }
+    if(recordPath) {
+        atexit(finishRecording); // Closing the window ends the round early
+        chunkSync = endless; // Chunks load on the same ticks as when it is replayed
+    }
+#ifdef PROFILE
+    atexit(profWrite); // GLUT leaves its loop through exit()
+#endif
+
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
+    glutInitWindowSize(screenW, screenH);
+    
+    // Window Dimensions
+    int screenWidth = glutGet(GLUT_SCREEN_WIDTH);
+    int screenHeight = glutGet(GLUT_SCREEN_HEIGHT);
+    int windowX = (screenWidth - screenW) / 2;
+    int windowY = (screenHeight - screenH) / 2;
+    
+    glutInitWindowPosition(windowX, windowY);
+    glutCreateWindow("RayCaster");
+    
+    init();
+    
+    glutDisplayFunc(display);
+    glutKeyboardFunc(keyDown);
+    glutKeyboardUpFunc(keyUp);
+    glutReshapeFunc(resize);
+    glutIdleFunc(idle);
+    loopTime = nowMs();
+    
+    glutMainLoop();
+    return 0;
+}
+
+#else // HEADLESS
+
+// HEADLESS BENCHMARK
+// Build: gcc -O2 -pthread -DHEADLESS raycaster.c -o raycaster_bench -lm
+// Usage: raycaster_bench [-n frames] [-s seed] [-o frame.ppm] plus the game's render options
+//        raycaster_bench -mazes [-s seed]: maze generator throughput, 16x16 to 4096x4096
+//        raycaster_bench -replay file: plays a recorded round, one frame per tick, and
+//        exits with status 2 if it does not end where the recording did
+//        raycaster_bench -batch n [-o stats.csv|stats.bin]: lays out n rounds with seeds
+//        from -s on, across one process per -threads, and writes each one's statistics
+
+#define BENCH_PASSES 9
+#define MAX_POSES 512
+
+enum { PASS_CLEAR, PASS_CAST, PASS_CEILING, PASS_WALL, PASS_FLOOR, PASS_WIDEN, PASS_SPRITES, PASS_EXPAND, PASS_HUD };
+const char *benchPassNames[BENCH_PASSES] = { "clear", "raycast", "ceiling", "wall", "floor", "widen", "sprites", "expand", "hud" };
+
+typedef struct {
+    float x, y, a;
+} Pose;
+
+int compareDouble(const void *a, const void *b)
+{
+    double da = *(const double *)a, db = *(const double *)b;
+    return (da > db) - (da < db);
+}
+
+// Generates mazes with every algorithm at growing sizes and reports cells per second
+void benchMazes()
+{
+    int sizes[] = { 16, 64, 256, 1024, 4096 };
+    int a, s, reps;
+    double start, ms;
+
+    printf("%-12s %11s %8s %12s %14s\n", "algorithm", "size", "mazes", "ms/maze", "cells/s");
+    for(a = 0; a < MAZE_ALGORITHMS; a++)
+    {
+        mazeAlgorithm = a;
+        for(s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++)
+        {
+            mapX = mapY = sizes[s];
+            allocMap();
+
+            // Repeat small sizes until the timing is meaningful
+            reps = 0;
+            start = nowMs();
+            do {
+                rngSeed(&gameRng, gameSeed + reps);
+                generateMaze();
+                reps++;
+                ms = nowMs() - start;
+            } while(ms < 200);
+
+            printf("%-12s %5dx%-5d %8d %12.3f %14.0f\n", mazeAlgorithms[a].name, mapX, mapY, reps, ms / reps,
+                   (double)mapX * mapY * reps * 1000.0 / ms);
+        }
+    }
+}
+
+// Batch analysis: the rounds of seeds s, s+1, ... laid out exactly as resetGame() does
+// in the game and measured. The layout code works on the map globals, so the work is
+// split across forked processes, each with its own copy, instead of threads; process
+// j takes every jobs-th seed and writes fixed-size records to a pipe, which are read
+// back round-robin so the output stays in seed order. Windows has no fork(), so there
+// it runs in one process.
+#define STATS_MAGIC "MINOSTA1"
+#define STATS_VERSION 1
+#define STATS_BINS 10 // Key distance histogram, in tenths of the farthest distance
+
+typedef struct {
+    char magic[8]; // STATS_MAGIC
+    uint32_t version;
+    uint32_t mapW, mapH, maze; // Options the rounds were laid out with
+    uint32_t count; // Records that follow, fewer if the run was cut short
+} StatsHeader;
+
+// One round, all distances in steps between open cells
+typedef struct {
+    uint32_t seedLow, seedHigh;
+    uint32_t openCells; // Reachable from the spawn
+    uint32_t farthest; // Distance from the spawn to the farthest open cell
+    uint32_t solution; // Distance from the spawn to the door
+    uint32_t deadEnds; // Open cells with one way out
+    uint32_t junctions; // Open cells with three or more ways out
+    float branching; // Mean children of the cells that have any, in the tree of shortest paths from the spawn
+    uint32_t keys;
+    uint32_t keyDist[MAX_KEYS]; // Distance from the spawn to each key, 0 past 'keys'
+} MazeStats;
+
+void measureRound(unsigned long seed, MazeStats *st)
+{
+    int step[4], i, d, parents = 0;
+
+    gameSeed = seed;
+    resetGame();
+
+    memset(st, 0, sizeof(*st));
+    st->seedLow = (uint32_t)seed;
+    st->seedHigh = (uint32_t)((uint64_t)seed >> 32);
+    st->openCells = openCount;
+    st->farthest = spawnDist[openCells[openCount - 1]];
+
+    step[0] = 1; step[1] = -1; step[2] = mapX; step[3] = -mapX;
+    for(i = 0; i < openCount; i++)
+    {
+        int cell = openCells[i], ways = 0, children = 0;
+        for(d = 0; d < 4; d++) {
+            int n = cell + step[d];
+            if(isSolidCell(n)) {
+                if(map[n] == 4) st->solution = spawnDist[cell] + 1; // The door is next to one open cell
+                continue;
+            }
+            ways++;
+            if(spawnDist[n] == spawnDist[cell] + 1) children++;
+        }
+        if(ways == 1) st->deadEnds++;
+        if(ways >= 3) st->junctions++;
+        if(children) parents++;
+    }
+    st->branching = parents ? (float)(openCount - 1) / parents : 0;
+
+    for(i = 0; i < entityCount; i++) {
+        if(entities[i].active && entities[i].kind == ENTITY_KEY && st->keys < MAX_KEYS)
+            st->keyDist[st->keys++] = spawnDist[entities[i].cell];
+    }
+}
+
+void writeStats(FILE *out, int csv, const MazeStats *st)
+{
+    int k;
+
+    if(!csv) {
+        fwrite(st, sizeof(*st), 1, out);
+        return;
+    }
+    fprintf(out, "%llu,%u,%u,%u,%u,%u,%.4f,%u", ((unsigned long long)st->seedHigh << 32) | st->seedLow, st->openCells,
+            st->farthest, st->solution, st->deadEnds, st->junctions, st->branching, st->keys);
+    for(k = 0; k < MAX_KEYS; k++) {
+        if(k < (int)st->keys) fprintf(out, ",%u", st->keyDist[k]);
+        else fprintf(out, ",");
+    }
+    fprintf(out, "\n");
+}
+
+// Lays out 'count' rounds and streams their statistics to 'path' (CSV if it ends in
+// .csv, else StatsHeader and MazeStats records), then prints throughput and totals
+int runBatch(int count, const char *path)
+{
+    FILE *out = NULL;
+#ifndef _WIN32
+    FILE *pipes[MAX_THREADS];
+#endif
+    int csv = 0, jobs = 1, i, k, bin;
+    unsigned long firstSeed = gameSeed;
+    double start = nowMs(), seconds, solution = 0, deadEnds = 0, branching = 0;
+    long long keyCount = 0, keySum = 0, histogram[STATS_BINS] = {0};
+    uint32_t keyMin = UINT32_MAX, keyMax = 0;
+    MazeStats st;
+
+    if(endless) {
+        fprintf(stderr, "-batch needs a finite maze (no -endless)\n");
+        return 1;
+    }
+    if(path) {
+        csv = strlen(path) > 4 && !strcmp(path + strlen(path) - 4, ".csv");
+        out = fopen(path, csv ? "w" : "wb");
+        if(!out) {
+            fprintf(stderr, "cannot write %s\n", path);
+            return 1;
+        }
+        if(csv) {
+            fprintf(out, "seed,open_cells,farthest,solution,dead_ends,junctions,branching,keys");
+            for(k = 0; k < MAX_KEYS; k++) fprintf(out, ",key%d", k + 1);
+            fprintf(out, "\n");
+        } else {
+            StatsHeader h;
+            memset(&h, 0, sizeof(h));
+            memcpy(h.magic, STATS_MAGIC, 8);
+            h.version = STATS_VERSION;
+            h.mapW = mapX;
+            h.mapH = mapY;
+            h.maze = mazeAlgorithm;
+            h.count = count;
+            fwrite(&h, sizeof(h), 1, out);
+        }
+    }
+    minotaurOption = 0; // Placed after the keys, so they change nothing measured
+
+#ifndef _WIN32
+    jobs = numThreads > 0 ? numThreads : cpuCount();
+    if(jobs > MAX_THREADS) jobs = MAX_THREADS;
+    if(jobs > count) jobs = count;
+    fflush(NULL); // Or the children write out the parent's buffers too
+    for(k = 0; k < jobs; k++)
+    {
+        int fds[2];
+        pid_t pid;
+
+        if(pipe(fds) != 0 || (pid = fork()) < 0) {
+            fprintf(stderr, "cannot start batch process %d\n", k);
+            return 1;
+        }
+        if(pid == 0) {
+            FILE *records = fdopen(fds[1], "wb");
+            close(fds[0]);
+            for(i = k; i < count; i += jobs) {
+                measureRound(firstSeed + i, &st);
+                if(fwrite(&st, sizeof(st), 1, records) != 1) break; // The parent is gone
+            }
+            fclose(records);
+            _exit(0);
+        }
+        close(fds[1]);
+        pipes[k] = fdopen(fds[0], "rb");
+    }
+#endif
+
+    for(i = 0; i < count; i++)
+    {
+#ifdef _WIN32
+        measureRound(firstSeed + i, &st);
+#else
+        if(fread(&st, sizeof(st), 1, pipes[i % jobs]) != 1) {
+            fprintf(stderr, "batch process %d stopped early\n", i % jobs);
+            break;
+        }
+#endif
+        if(out) writeStats(out, csv, &st);
+
+        solution += st.solution;
+        deadEnds += st.deadEnds;
+        branching += st.branching;
+        for(k = 0; k < (int)st.keys; k++) {
+            uint32_t steps = st.keyDist[k];
+            bin = st.farthest ? (int)((uint64_t)steps * STATS_BINS / st.farthest) : 0;
+            histogram[bin < STATS_BINS ? bin : STATS_BINS - 1]++;
+            keySum += steps;
+            keyCount++;
+            if(steps < keyMin) keyMin = steps;
+            if(steps > keyMax) keyMax = steps;
+        }
+    }
+    count = i;
+    seconds = (nowMs() - start) / 1000.0;
+
+#ifndef _WIN32
+    for(k = 0; k < jobs; k++) fclose(pipes[k]); // A child still writing gets EPIPE and stops
+    while(wait(NULL) > 0) {}
+#endif
+    if(out) fclose(out);
+
+    printf("%d mazes %dx%d (%s), seeds %lu on, %d processes: %.2f s, %.0f mazes/s, %.0f cells/s\n", count, mapX, mapY,
+           mazeAlgorithms[mazeAlgorithm].name, firstSeed, jobs, seconds, count / seconds,
+           (double)mapX * mapY * count / seconds);
+    if(count == 0) return 1;
+    printf("mean solution %.1f, dead ends %.1f, branching %.3f\n", solution / count, deadEnds / count, branching / count);
+    if(keyCount) {
+        printf("keys %lld, distance from spawn min %u mean %.1f max %u; by fraction of the farthest cell:\n",
+               keyCount, keyMin, (double)keySum / keyCount, keyMax);
+        for(bin = 0; bin < STATS_BINS; bin++) {
+            printf("  %3d-%3d%%  %6.2f%%\n", bin * 100 / STATS_BINS, (bin + 1) * 100 / STATS_BINS,
+                   histogram[bin] * 100.0 / keyCount);
+        }
+    }
+    return 0;
+}
+
+// Camera poses: every open cell in scan order, looking in 8 directions
+int buildPoses(Pose *poses, int maxPoses)
+{
+    // Endless mode: the chunks loaded around the start
+    int origin = endless ? (WORLD_CHUNKS / 2 - CHUNK_RADIUS) * CHUNK_CELLS : 0;
+    int sizeX = endless ? (CHUNK_RADIUS * 2 + 1) * CHUNK_CELLS : mapX;
+    int sizeY = endless ? sizeX : mapY;
+    int x, y, d, cell, count = 0;
+    for(y = origin; y < origin + sizeY; y++) {
+        for(x = origin; x < origin + sizeX; x++) {
+            cell = cellIndex(x, y);
+            if(cell < 0 || map[cell] != 0) continue;
+            for(d = 0; d < 8 && count < maxPoses; d++) {
+                poses[count].x = x * mapS + mapS / 2.0f;
+                poses[count].y = y * mapS + mapS / 2.0f;
+                poses[count].a = FixAng(d * PI / 4.0f + 0.1f);
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+// Writes the column-major framebuffer as a binary PPM
+int writeFramePPM(const char *path)
+{
+    int x, y;
+    FILE *f = fopen(path, "wb");
+    if(!f) return 0;
+    fprintf(f, "P6\n%d %d\n255\n", renderW, renderH);
+    for(y = 0; y < renderH; y++) {
+        for(x = 0; x < renderW; x++) {
+            uint32_t c = frameColumn(x)[y];
+            fputc(c & 0xFF, f);
+            fputc((c >> 8) & 0xFF, f);
+            fputc((c >> 16) & 0xFF, f);
+        }
+    }
+    fclose(f);
+    return 1;
+}
+
+int main(int argc, char* argv[])
+{
+    int frames = 500;
+    int mazes = 0, batch = 0;
+    const char *outPath = NULL;
+    static Pose poses[MAX_POSES];
+    int poseCount, f, p, i, used;
+    double *frameMs;
+    double passMs[BENCH_PASSES] = {0};
+    double t[BENCH_PASSES + 1];
+    double totalMs = 0;
+
+    gameSeed = 12345;
+    for(i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-n") && i + 1 < argc) frames = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-s") && i + 1 < argc) gameSeed = strtoul(argv[++i], NULL, 10);
+        else if(!strcmp(argv[i], "-mazes")) mazes = 1;
+        else if(!strcmp(argv[i], "-batch") && i + 1 < argc && atoi(argv[i + 1]) > 0) batch = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-replay") && i + 1 < argc) replayPath = argv[++i];
+        else if(!strcmp(argv[i], "-o") && i + 1 < argc) outPath = argv[++i];
+        else if((used = parseRenderOption(argc, argv, i)) != 0) i += used - 1;
+        else {
+            fprintf(stderr, "usage: %s [-n frames] [-s seed] [-o frame.ppm|stats.csv] [-mazes] [-batch n] [-replay file] " RENDER_USAGE "\n", argv[0]);
+            return 1;
+        }
+    }
+    if(replayPath) {
+        // The recording decides the maze and how many frames there are
+        if(!openReplay(replayPath)) {
+            fprintf(stderr, "%s is not a finished recording\n", replayPath);
+            return 1;
+        }
+        frames = (int)replayHeader()->ticks;
+    }
+    if(frames < 1) frames = 1;
+    if(mazes) {
+        benchMazes();
+        return 0;
+    }
+    if(batch) return runBatch(batch, outPath);
+
+    // Fixed resolution: the benchmark measures, it does not adapt
+    frameBudgetMs = 0;
+    startWorkers();
+    setScreenSize(screenW, screenH);
+    initTextures();
+    initSprites();
+    if(indexedColor) initPalette();
+
+    // Fixed seed so every run renders the same maze and keys
+    resetGame();
+    gameStarted = 1;
+
+    poseCount = buildPoses(poses, MAX_POSES);
+    frameMs = (double *)malloc(frames * sizeof(double));
+    if(!frameMs || poseCount == 0) {
+        fprintf(stderr, "benchmark setup failed\n");
+        return 1;
+    }
+
+#ifdef PROFILE
+    atexit(profWrite);
+#endif
+    for(f = 0; f < frames; f++)
+    {
+        if(replayPath) {
+            if(!replayTick()) {
+                fprintf(stderr, "%s ended before tick %d\n", replayPath, f);
+                return 2;
+            }
+        } else {
+            Pose *pose = &poses[f % poseCount];
+            px = pose->x; py = pose->y; pa = pose->a;
+            pdx = cosf(pa) * 5.0f; pdy = sinf(pa) * 5.0f;
+            savePose();
+        }
+        interpolateView(1.0f);
+
+        PROF_FRAME();
+        t[0] = nowMs();
+        PROF_BEGIN(PROF_CLEAR);
+        clearFrame(PACK_RGB(51, 51, 51));
+        PROF_END(PROF_CLEAR);
+        t[1] = nowMs();
+        PROF_BEGIN(PROF_RAYCAST);
+        castRays();
+        PROF_END(PROF_RAYCAST);
+        t[2] = nowMs();
+        PROF_BEGIN(PROF_CEILING);
+        drawCeiling();
+        PROF_END(PROF_CEILING);
+        t[3] = nowMs();
+        PROF_BEGIN(PROF_WALLS);
+        drawWalls();
+        PROF_END(PROF_WALLS);
+        t[4] = nowMs();
+        PROF_BEGIN(PROF_FLOOR);
+        drawFloor();
+        PROF_END(PROF_FLOOR);
+        t[5] = nowMs();
+        // Widening copies each ray's first column across its group, floor included,
+        // so it comes last as in drawRays3D()
+        PROF_BEGIN(PROF_WIDEN);
+        widenColumns();
+        PROF_END(PROF_WIDEN);
+        t[6] = nowMs();
+        PROF_BEGIN(PROF_SPRITES);
+        drawEntities();
+        PROF_END(PROF_SPRITES);
+        t[7] = nowMs();
+        PROF_BEGIN(PROF_UPLOAD); // Stands in for the upload, as in the game
+        if(indexedColor) expandFrame();
+        PROF_END(PROF_UPLOAD);
+        t[8] = nowMs();
+        PROF_BEGIN(PROF_HUD);
+        drawHUD();
+        PROF_END(PROF_HUD);
+        t[9] = nowMs();
+
+        for(p = 0; p < BENCH_PASSES; p++) passMs[p] += t[p + 1] - t[p];
+        frameMs[f] = t[BENCH_PASSES] - t[0];
+        totalMs += frameMs[f];
+    }
+
+    PROF_FRAME(); // Close the last frame
+    qsort(frameMs, frames, sizeof(double), compareDouble);
+    printf("frames %d, poses %d, seed %lu, %dx%d, %d rays, fov %.0f, %d threads\n", frames, poseCount, gameSeed, renderW, renderH, numRays, fov / DR, numThreads);
+    printf("frame ms: min %.3f  median %.3f  p99 %.3f  mean %.3f\n",
+           frameMs[0], frameMs[frames / 2], frameMs[(int)((frames - 1) * 0.99)], totalMs / frames);
+    for(p = 0; p < BENCH_PASSES; p++) {
+        double ms = passMs[p] / frames;
+        double raysPerSec = ms > 0 ? numRays * 1000.0 / ms : 0;
+        printf("  %-8s %8.3f ms/frame  %12.0f rays/s\n", benchPassNames[p], ms, raysPerSec);
+    }
+
+    if(outPath && !writeFramePPM(outPath)) {
+        fprintf(stderr, "could not write %s\n", outPath);
+    }
+    free(frameMs);
+    if(replayPath && !checkReplay()) return 2;
+    return 0;
+}
+#endif // HEADLESS